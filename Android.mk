@@ -8,6 +8,13 @@ LOCAL_SRC_FILES:= \
 	main.c \
 	util.c \
 	framebuffer.c \
+	blend.c \
+	fb_backends.c \
+	workers.c \
+	fb_format.c \
+	fb_image.c \
+	fb_timing.c \
+	pool.c \
 	multirom.c \
 	input.c \
 	multirom_ui.c \
@@ -16,7 +23,11 @@ LOCAL_SRC_FILES:= \
 	button.c \
 	pong.c \
 	progressdots.c \
-	adb.c
+	widget.c \
+	timers.c \
+	adb.c \
+	screenshot.c \
+	fb_remote.c
 
 LOCAL_MODULE:= multirom
 LOCAL_MODULE_TAGS := eng
@@ -33,6 +44,14 @@ LOCAL_C_INCLUDES += external/libselinux/include
 LOCAL_CFLAGS += -DHAVE_SELINUX
 endif
 
+ifeq ($(MR_FB_TIMING),true)
+LOCAL_CFLAGS += -DMR_FB_TIMING
+endif
+
+ifeq ($(MR_FB_REMOTE),true)
+LOCAL_CFLAGS += -DMR_FB_REMOTE
+endif
+
 include $(BUILD_EXECUTABLE)
 
 # Trampoline
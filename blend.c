@@ -0,0 +1,260 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#include "blend.h"
+#include "log.h"
+
+// All implementations must be bit-exact with blend_channel().
+// r = (255-ALPHA)*value + ALPHA*BLEND_CLR is at most 14865, so the whole
+// computation fits into 16bit lanes. Vector paths fold the +1 into the
+// added constant, which gives the same result for all 256 input values.
+#define BLEND_MUL (0xFF - BLEND_ALPHA)
+#define BLEND_ADD (BLEND_ALPHA*BLEND_CLR)
+
+static blend_func blend_impl = NULL;
+static const char *blend_name = "none";
+
+// RGB565 channels are blended through tables indexed by the channel value,
+// already shifted to their place in the pixel
+static uint16_t blend_565_r[32];
+static uint16_t blend_565_g[64];
+static uint16_t blend_565_b[32];
+
+static inline uint32_t blend_channel(uint32_t value)
+{
+    uint32_t r = BLEND_MUL*value + BLEND_ADD;
+    return (r+1 + (r >> 8)) >> 8; // divide by 255
+}
+
+void blend_overlay_c(uint32_t *px, int count)
+{
+    uint32_t p;
+    for(; count > 0; --count, ++px)
+    {
+        p = *px;
+        *px = (p & 0xFF000000) |
+            (blend_channel((p >> 16) & 0xFF) << 16) |
+            (blend_channel((p >> 8) & 0xFF) << 8) |
+            blend_channel(p & 0xFF);
+    }
+}
+
+static void blend_init_565(void)
+{
+    uint32_t i, v;
+
+    for(i = 0; i < 32; ++i)
+    {
+        v = blend_channel((i << 3) | (i >> 2)) >> 3;
+        blend_565_r[i] = v << 11;
+        blend_565_b[i] = v;
+    }
+
+    for(i = 0; i < 64; ++i)
+        blend_565_g[i] = (blend_channel((i << 2) | (i >> 4)) >> 2) << 5;
+}
+
+void blend_overlay_565(uint16_t *px, int count)
+{
+    uint16_t p;
+    for(; count > 0; --count, ++px)
+    {
+        p = *px;
+        *px = blend_565_r[p >> 11] | blend_565_g[(p >> 5) & 0x3F] | blend_565_b[p & 0x1F];
+    }
+}
+
+#if defined(__ARM_NEON__)
+static inline uint8x8_t blend_neon_u8(uint8x8_t v, uint8x8_t mul, uint16x8_t add)
+{
+    uint16x8_t r = vmlal_u8(add, v, mul);
+    r = vaddq_u16(r, vshrq_n_u16(r, 8));
+    return vshrn_n_u16(r, 8);
+}
+
+void blend_overlay_neon(uint32_t *px, int count)
+{
+    const uint8x8_t mul = vdup_n_u8(BLEND_MUL);
+    const uint16x8_t add = vdupq_n_u16(BLEND_ADD + 1);
+    uint8x8x4_t v;
+
+    for(; count >= 8; count -= 8, px += 8)
+    {
+        v = vld4_u8((uint8_t*)px);
+        v.val[0] = blend_neon_u8(v.val[0], mul, add);
+        v.val[1] = blend_neon_u8(v.val[1], mul, add);
+        v.val[2] = blend_neon_u8(v.val[2], mul, add);
+        vst4_u8((uint8_t*)px, v);
+    }
+
+    blend_overlay_c(px, count);
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i blend_sse2_u16(__m128i v, __m128i mul, __m128i add)
+{
+    __m128i r = _mm_add_epi16(_mm_mullo_epi16(v, mul), add);
+    r = _mm_add_epi16(r, _mm_srli_epi16(r, 8));
+    return _mm_srli_epi16(r, 8);
+}
+
+void blend_overlay_sse2(uint32_t *px, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(BLEND_MUL);
+    const __m128i add = _mm_set1_epi16(BLEND_ADD + 1);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    __m128i v, lo, hi;
+
+    for(; count >= 4; count -= 4, px += 4)
+    {
+        v = _mm_loadu_si128((__m128i*)px);
+        lo = blend_sse2_u16(_mm_unpacklo_epi8(v, zero), mul, add);
+        hi = blend_sse2_u16(_mm_unpackhi_epi8(v, zero), mul, add);
+        lo = _mm_packus_epi16(lo, hi);
+        v = _mm_or_si128(_mm_and_si128(v, alpha), _mm_andnot_si128(alpha, lo));
+        _mm_storeu_si128((__m128i*)px, v);
+    }
+
+    blend_overlay_c(px, count);
+}
+
+__attribute__((target("avx2")))
+void blend_overlay_avx2(uint32_t *px, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mul = _mm256_set1_epi16(BLEND_MUL);
+    const __m256i add = _mm256_set1_epi16(BLEND_ADD + 1);
+    const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+    __m256i v, lo, hi;
+
+    for(; count >= 8; count -= 8, px += 8)
+    {
+        // unpack and pack work within 128bit lanes, so the order matches
+        v = _mm256_loadu_si256((__m256i*)px);
+        lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), mul), add);
+        hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), mul), add);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        lo = _mm256_packus_epi16(lo, hi);
+        v = _mm256_or_si256(_mm256_and_si256(v, alpha), _mm256_andnot_si256(alpha, lo));
+        _mm256_storeu_si256((__m256i*)px, v);
+    }
+
+    blend_overlay_sse2(px, count);
+}
+#endif
+
+#if defined(__ARM_NEON__)
+#define AT_HWCAP 16
+#define HWCAP_NEON (1 << 12)
+
+static int blend_cpu_has_neon(void)
+{
+    // getauxval() is not available in our bionic
+    unsigned long aux[2];
+    int res = 0;
+    int fd = open("/proc/self/auxv", O_RDONLY);
+    if(fd < 0)
+        return 1; // built with -mfpu=neon, assume it is there
+
+    while(read(fd, aux, sizeof(aux)) == sizeof(aux) && aux[0] != 0)
+    {
+        if(aux[0] == AT_HWCAP)
+        {
+            res = (aux[1] & HWCAP_NEON) != 0;
+            break;
+        }
+    }
+    close(fd);
+    return res;
+}
+#endif
+
+// check the vector implementation against the scalar one on all
+// channel values, it is cheap and we really don't want garbage on screen.
+// The noise comes from a local LCG, rand() would move the seed pong and
+// the input recordings depend on.
+static int blend_verify(blend_func f)
+{
+    uint32_t a[259], b[259];
+    uint32_t seed = 1;
+    int i;
+
+    for(i = 0; i < (int)(sizeof(a)/sizeof(a[0])); ++i)
+    {
+        seed = seed*1103515245 + 12345;
+        a[i] = ((uint32_t)i*0x01030507) ^ ((seed >> 16) << 8);
+    }
+
+    memcpy(b, a, sizeof(a));
+    blend_overlay_c(a, sizeof(a)/sizeof(a[0]));
+    f(b, sizeof(b)/sizeof(b[0]));
+
+    return memcmp(a, b, sizeof(a)) == 0;
+}
+
+static void blend_select(blend_func f, const char *name)
+{
+    if(blend_impl != NULL && blend_impl != blend_overlay_c)
+        return;
+
+    if(!blend_verify(f))
+    {
+        ERROR("blend: %s implementation is broken, not using it\n", name);
+        return;
+    }
+
+    blend_impl = f;
+    blend_name = name;
+}
+
+void blend_init(void)
+{
+    if(blend_impl)
+        return;
+
+    blend_init_565();
+
+#if defined(__ARM_NEON__)
+    if(blend_cpu_has_neon())
+        blend_select(blend_overlay_neon, "neon");
+#endif
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        blend_select(blend_overlay_avx2, "avx2");
+    blend_select(blend_overlay_sse2, "sse2");
+#endif
+
+    if(!blend_impl)
+    {
+        blend_impl = blend_overlay_c;
+        blend_name = "c";
+    }
+
+    INFO("blend: using %s implementation\n", blend_name);
+}
+
+void blend_overlay(uint32_t *px, int count)
+{
+    if(!blend_impl)
+        blend_init();
+    (*blend_impl)(px, count);
+}
+
+const char *blend_impl_name(void)
+{
+    return blend_name;
+}
@@ -0,0 +1,28 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <stdint.h>
+
+// Dims pixels towards BLEND_CLR, used as background of msgboxes. The 32bit
+// paths work on any format with alpha (or padding) in the top byte and
+// leave it untouched, blend_overlay_565() handles RGB565.
+#define BLEND_ALPHA 220
+#define BLEND_CLR 0x1B
+
+typedef void (*blend_func)(uint32_t *, int); // pixels, count
+
+void blend_init(void);
+void blend_overlay(uint32_t *px, int count);
+const char *blend_impl_name(void);
+void blend_overlay_565(uint16_t *px, int count);
+
+void blend_overlay_c(uint32_t *px, int count);
+#if defined(__ARM_NEON__)
+void blend_overlay_neon(uint32_t *px, int count);
+#endif
+#if defined(__SSE2__)
+void blend_overlay_sse2(uint32_t *px, int count);
+void blend_overlay_avx2(uint32_t *px, int count);
+#endif
+
+#endif
@@ -20,14 +20,16 @@ void button_init_ui(button *b, const char *text, int size)
         b->c[CLR_CHECK][0] = CLR_SECONDARY;
         b->c[CLR_CHECK][1] = WHITE;
 
-        b->rect = fb_add_rect(b->x, b->y, b->w, b->h, b->c[CLR_NORMAL][0]);
+        b->ui = widget_create(NULL, b->x, b->y);
+        b->rect = widget_add_rect(b->ui, 0, 0, b->w, b->h, b->c[CLR_NORMAL][0]);
 
-        int text_x = center_x(b->x, b->w, size, text);
-        int text_y = center_y(b->y, b->h, size);
-        b->text = fb_add_text(text_x, text_y, b->c[CLR_NORMAL][1], size, text);
+        int text_x = center_x(0, b->w, size, text);
+        int text_y = center_y(0, b->h, size);
+        b->text = widget_add_text(b->ui, text_x, text_y, b->c[CLR_NORMAL][1], size, text);
     }
     else
     {
+        b->ui = NULL;
         b->text = NULL;
         b->rect = NULL;
     }
@@ -39,12 +41,7 @@ void button_destroy(button *b)
 {
     rm_touch_handler(&button_touch_handler, b);
 
-    if(b->text)
-    {
-        fb_rm_rect(b->rect);
-        fb_rm_text(b->text);
-    }
-
+    widget_destroy(b->ui);
     free(b);
 }
 
@@ -53,14 +50,8 @@ void button_move(button *b, int x, int y)
     b->x = x;
     b->y = y;
 
-    if(b->text)
-    {
-        b->rect->head.x = x;
-        b->rect->head.y = y;
-
-        b->text->head.x = center_x(x, b->w, b->text->size, b->text->text);
-        b->text->head.y = center_y(y, b->h, b->text->size);
-    }
+    if(b->ui)
+        widget_move(b->ui, x, y);
 }
 
 void button_set_hover(button *b, int hover)
@@ -3,6 +3,7 @@
 
 #include "framebuffer.h"
 #include "input.h"
+#include "widget.h"
 
 enum 
 {
@@ -25,6 +26,7 @@ typedef struct
 {
     int x, y;
     int w, h;
+    widget *ui;
     fb_text *text;
     fb_rect *rect;
 
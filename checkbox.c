@@ -12,20 +12,19 @@
 #define SELECTED_PADDING (BORDER_SIZE + BORDER_PADDING)
 #define TOUCH 15
 
-checkbox *checkbox_create(int x, int y, void (*clicked)(int))
+checkbox *checkbox_create(widget *parent, int x, int y, void (*clicked)(int))
 {
     checkbox *c = malloc(sizeof(checkbox));
     memset(c, 0, sizeof(checkbox));
 
     c->touch_id = -1;
     c->clicked = clicked;
+    c->ui = widget_create(parent, x, y);
 
-    c->borders[BORDER_L] = fb_add_rect(0, 0, BORDER_SIZE, CHECKBOX_SIZE, WHITE);
-    c->borders[BORDER_R] = fb_add_rect(0, 0, BORDER_SIZE, CHECKBOX_SIZE, WHITE);
-    c->borders[BORDER_T] = fb_add_rect(0, 0, CHECKBOX_SIZE, BORDER_SIZE, WHITE);
-    c->borders[BORDER_B] = fb_add_rect(0, 0, CHECKBOX_SIZE, BORDER_SIZE, WHITE);
-
-    checkbox_set_pos(c, x, y);
+    c->borders[BORDER_L] = widget_add_rect(c->ui, 0, 0, BORDER_SIZE, CHECKBOX_SIZE, WHITE);
+    c->borders[BORDER_R] = widget_add_rect(c->ui, CHECKBOX_SIZE - BORDER_SIZE, 0, BORDER_SIZE, CHECKBOX_SIZE, WHITE);
+    c->borders[BORDER_T] = widget_add_rect(c->ui, 0, 0, CHECKBOX_SIZE, BORDER_SIZE, WHITE);
+    c->borders[BORDER_B] = widget_add_rect(c->ui, 0, CHECKBOX_SIZE - BORDER_SIZE, CHECKBOX_SIZE, BORDER_SIZE, WHITE);
 
     if(c->clicked)
         add_touch_handler(&checkbox_touch_handler, c);
@@ -35,47 +34,16 @@ checkbox *checkbox_create(int x, int y, void (*clicked)(int))
 
 void checkbox_destroy(checkbox *c)
 {
-    int i;
-    for(i = 0; i < BORDER_MAX; ++i)
-        fb_rm_rect(c->borders[i]);
-
-    fb_rm_rect(c->selected);
-
     if(c->clicked)
         rm_touch_handler(&checkbox_touch_handler, c);
 
+    widget_destroy(c->ui);
     free(c);
 }
 
 void checkbox_set_pos(checkbox *c, int x, int y)
 {
-    c->x = x;
-    c->y = y;
-
-    int pos[][2] =
-    {
-        // BORDER_L
-        { x, y, },
-        // BORDER_R
-        { x + CHECKBOX_SIZE - BORDER_SIZE, y },
-        // BORDER_T
-        { x, y },
-        // BORDER_B
-        { x, y + CHECKBOX_SIZE - BORDER_SIZE }
-    };
-
-    int i;
-    for(i = 0; i < BORDER_MAX; ++i)
-    {
-        c->borders[i]->head.x = pos[i][0];
-        c->borders[i]->head.y = pos[i][1];
-    }
-
-    if(c->selected)
-    {
-        c->selected->head.x = x + SELECTED_PADDING;
-        c->selected->head.y = y + SELECTED_PADDING;
-    }
+    widget_move(c->ui, x, y);
 }
 
 void checkbox_select(checkbox *c, int select)
@@ -85,12 +53,12 @@ void checkbox_select(checkbox *c, int select)
 
     if(select)
     {
-        c->selected = fb_add_rect(c->x + SELECTED_PADDING, c->y + SELECTED_PADDING,
-                                  SELECTED_SIZE, SELECTED_SIZE, CLR_PRIMARY);
+        c->selected = widget_add_rect(c->ui, SELECTED_PADDING, SELECTED_PADDING,
+                                      SELECTED_SIZE, SELECTED_SIZE, CLR_PRIMARY);
     }
     else
     {
-        fb_rm_rect(c->selected);
+        widget_rm_item(c->ui, c->selected);
         c->selected = NULL;
     }
 }
@@ -98,14 +66,16 @@ void checkbox_select(checkbox *c, int select)
 int checkbox_touch_handler(touch_event *ev, void *data)
 {
     checkbox *box = (checkbox*)data;
+    int x = box->ui->abs_x;
+    int y = box->ui->abs_y;
 
     if(box->touch_id == -1 && (ev->changed & TCHNG_ADDED))
     {
-        if(!in_rect(ev->x, ev->y, box->x-TOUCH, box->y-TOUCH, CHECKBOX_SIZE+TOUCH*2, CHECKBOX_SIZE+TOUCH*2))
+        if(!in_rect(ev->x, ev->y, x-TOUCH, y-TOUCH, CHECKBOX_SIZE+TOUCH*2, CHECKBOX_SIZE+TOUCH*2))
             return -1;
 
         box->touch_id = ev->id;
-        box->hover = fb_add_rect(box->x-TOUCH, box->y-TOUCH, CHECKBOX_SIZE+TOUCH*2, CHECKBOX_SIZE+TOUCH*2, CLR_SECONDARY);
+        box->hover = widget_add_rect(box->ui, -TOUCH, -TOUCH, CHECKBOX_SIZE+TOUCH*2, CHECKBOX_SIZE+TOUCH*2, CLR_SECONDARY);
         fb_draw();
     }
 
@@ -114,13 +84,13 @@ int checkbox_touch_handler(touch_event *ev, void *data)
 
     if(ev->changed & TCHNG_REMOVED)
     {
-        if(in_rect(ev->x, ev->y, box->x-TOUCH, box->y-TOUCH, CHECKBOX_SIZE+TOUCH*2, CHECKBOX_SIZE+TOUCH*2))
+        if(in_rect(ev->x, ev->y, x-TOUCH, y-TOUCH, CHECKBOX_SIZE+TOUCH*2, CHECKBOX_SIZE+TOUCH*2))
         {
             (*box->clicked)(box->selected == NULL);
             checkbox_select(box, (box->selected == NULL));
         }
 
-        fb_rm_rect(box->hover);
+        widget_rm_item(box->ui, box->hover);
         box->hover = NULL;
         box->touch_id = -1;
 
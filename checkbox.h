@@ -3,6 +3,7 @@
 
 #include "framebuffer.h"
 #include "input.h"
+#include "widget.h"
 
 #define CHECKBOX_SIZE 30
 
@@ -18,7 +19,7 @@ enum
 
 typedef struct
 {
-    int x, y;
+    widget *ui;
     fb_rect *selected;
     fb_rect *borders[BORDER_MAX];
     int touch_id;
@@ -26,7 +27,8 @@ typedef struct
     fb_rect *hover;
 } checkbox;
 
-checkbox *checkbox_create(int x, int y, void (*clicked)(int));
+// x and y are relative to parent, which may be NULL
+checkbox *checkbox_create(widget *parent, int x, int y, void (*clicked)(int));
 void checkbox_destroy(checkbox *c);
 
 void checkbox_set_pos(checkbox *c, int x, int y);
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+#include <linux/fb.h>
+
+#include "log.h"
+#include "framebuffer.h"
+#include "util.h"
+
+static void fb_backend_free(fb_backend *b)
+{
+    free(b->data);
+    free(b);
+}
+
+void fb_backend_destroy(fb_backend *b)
+{
+    if(b)
+        (*b->destroy)(b);
+}
+
+/*
+ * fbdev - /dev/graphics/fb0 or any other linux framebuffer device
+ */
+static void *fbdev_open(fb_backend *b, struct fb_var_screeninfo *vi, struct fb_fix_screeninfo *fi)
+{
+    const char *path = (const char*)b->data;
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        return NULL;
+
+    if (ioctl(fd, FBIOGET_FSCREENINFO, fi) < 0)
+        goto fail;
+    if (ioctl(fd, FBIOGET_VSCREENINFO, vi) < 0)
+        goto fail;
+
+    // page flipping needs room for two pages in the virtual resolution
+    if (vi->yres_virtual < vi->yres*2 && fi->smem_len >= vi->yres*fi->line_length*2)
+    {
+        vi->yres_virtual = vi->yres*2;
+        if (ioctl(fd, FBIOPUT_VSCREENINFO, vi) < 0 || ioctl(fd, FBIOGET_VSCREENINFO, vi) < 0)
+            ERROR("fb: failed to set yres_virtual to %u\n", vi->yres*2);
+    }
+
+    void *bits = mmap(0, fi->smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (bits == MAP_FAILED)
+        goto fail;
+
+    b->fd = fd;
+    return bits;
+
+fail:
+    close(fd);
+    return NULL;
+}
+
+static void fbdev_close(fb_backend *b, void *mapped, struct fb_fix_screeninfo *fi)
+{
+    munmap(mapped, fi->smem_len);
+    close(b->fd);
+    b->fd = -1;
+}
+
+static int fbdev_set_page(fb_backend *b, struct fb_var_screeninfo *vi, unsigned n)
+{
+    vi->yoffset = n * vi->yres;
+    return ioctl(b->fd, FBIOPUT_VSCREENINFO, vi);
+}
+
+fb_backend *fb_backend_fbdev(const char *path)
+{
+    fb_backend *b = malloc(sizeof(fb_backend));
+    memset(b, 0, sizeof(fb_backend));
+
+    b->name = "fbdev";
+    b->fd = -1;
+    b->data = strdup(path ? path : "/dev/graphics/fb0");
+    b->open = &fbdev_open;
+    b->close = &fbdev_close;
+    b->set_page = &fbdev_set_page;
+    b->destroy = &fb_backend_free;
+    return b;
+}
+
+/*
+ * memory - two pages in RAM, for running the UI headless
+ */
+typedef struct
+{
+    int w, h;
+    int format;
+    int line_length;
+    char *dir; // file backend only
+    unsigned frame;
+    void *pages;
+} mem_data;
+
+static void mem_fill_info(mem_data *d, struct fb_var_screeninfo *vi, struct fb_fix_screeninfo *fi)
+{
+    memset(vi, 0, sizeof(struct fb_var_screeninfo));
+    memset(fi, 0, sizeof(struct fb_fix_screeninfo));
+
+    vi->xres = vi->xres_virtual = d->w;
+    vi->yres = d->h;
+    vi->yres_virtual = d->h*2;
+    fb_format_set_vi(d->format, vi);
+
+    fi->line_length = d->line_length;
+    fi->smem_len = fi->line_length*vi->yres_virtual;
+    strcpy(fi->id, "memory");
+}
+
+static void *mem_open(fb_backend *b, struct fb_var_screeninfo *vi, struct fb_fix_screeninfo *fi)
+{
+    mem_data *d = (mem_data*)b->data;
+
+    mem_fill_info(d, vi, fi);
+
+    free(d->pages);
+    d->pages = calloc(1, fi->smem_len);
+    d->frame = 0;
+    return d->pages;
+}
+
+static void mem_close(fb_backend *b, void *mapped, struct fb_fix_screeninfo *fi)
+{
+    // pages are kept until destroy, so that tests can still read them
+}
+
+static int mem_set_page(fb_backend *b, struct fb_var_screeninfo *vi, unsigned n)
+{
+    mem_data *d = (mem_data*)b->data;
+    vi->yoffset = n * vi->yres;
+    ++d->frame;
+    return 0;
+}
+
+static void mem_destroy(fb_backend *b)
+{
+    mem_data *d = (mem_data*)b->data;
+    free(d->pages);
+    free(d->dir);
+    fb_backend_free(b);
+}
+
+// line_length is in bytes, 0 means no padding
+fb_backend *fb_backend_memory_fmt(int w, int h, int format, int line_length)
+{
+    const fb_format *fmt = fb_format_get(format);
+    if(!fmt)
+        return NULL;
+
+    fb_backend *b = malloc(sizeof(fb_backend));
+    memset(b, 0, sizeof(fb_backend));
+
+    mem_data *d = malloc(sizeof(mem_data));
+    memset(d, 0, sizeof(mem_data));
+    d->w = w;
+    d->h = h;
+    d->format = format;
+    d->line_length = imax(line_length, w*fmt->bpp);
+
+    b->name = "memory";
+    b->fd = -1;
+    b->data = d;
+    b->open = &mem_open;
+    b->close = &mem_close;
+    b->set_page = &mem_set_page;
+    b->destroy = &mem_destroy;
+    return b;
+}
+
+// same layout as fb0 on grouper, 0xAABBGGRR
+fb_backend *fb_backend_memory(int w, int h)
+{
+    return fb_backend_memory_fmt(w, h, FB_FMT_RGBX8888, 0);
+}
+
+/*
+ * file - memory backend which writes every shown frame into
+ * dir/frame_NNNNN.raw, in the same layout as fb_clone() returns
+ */
+static int file_set_page(fb_backend *b, struct fb_var_screeninfo *vi, unsigned n)
+{
+    mem_data *d = (mem_data*)b->data;
+    char path[256];
+    int len = d->line_length*d->h;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/frame_%05u.raw", d->dir, d->frame);
+
+    mem_set_page(b, vi, n);
+
+    f = fopen(path, "w");
+    if(!f)
+    {
+        ERROR("fb: failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    fwrite(((uint8_t*)d->pages) + n*len, 1, len, f);
+    fclose(f);
+    return 0;
+}
+
+fb_backend *fb_backend_file(const char *dir, int w, int h)
+{
+    fb_backend *b = fb_backend_memory(w, h);
+    mem_data *d = (mem_data*)b->data;
+
+    d->dir = strdup(dir);
+    mkdir(dir, 0777);
+
+    b->name = "file";
+    b->set_page = &file_set_page;
+    return b;
+}
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <string.h>
+#include <linux/fb.h>
+#include <cutils/memory.h>
+
+#include "fb_format.h"
+#include "blend.h"
+#include "log.h"
+
+// Every format has its own fill and blend routines working on native
+// pixels, so that nothing has to be converted after rendering.
+
+static uint32_t rgbx8888_color(uint32_t color)
+{
+    return color;
+}
+
+static uint32_t bgrx8888_color(uint32_t color)
+{
+    return (color & 0xFF00FF00) | ((color & 0xFF) << 16) | ((color >> 16) & 0xFF);
+}
+
+static uint32_t rgb565_color(uint32_t color)
+{
+    return ((color & 0xF8) << 8) | ((color >> 5) & 0x7E0) | ((color >> 19) & 0x1F);
+}
+
+static uint32_t rgb565_to_color(uint32_t px)
+{
+    uint32_t r = (px >> 11) & 0x1F;
+    uint32_t g = (px >> 5) & 0x3F;
+    uint32_t b = px & 0x1F;
+    return 0xFF000000 | (((b << 3) | (b >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((r << 3) | (r >> 2));
+}
+
+static void fill32(void *dst, uint32_t px, int count)
+{
+    android_memset32((uint32_t*)dst, px, count*4);
+}
+
+static void fill16(void *dst, uint32_t px, int count)
+{
+    android_memset16((uint16_t*)dst, px, count*2);
+}
+
+static void blend32(void *dst, int count)
+{
+    blend_overlay((uint32_t*)dst, count);
+}
+
+static void blend16(void *dst, int count)
+{
+    blend_overlay_565((uint16_t*)dst, count);
+}
+
+static const fb_format formats[FB_FMT_COUNT] = {
+    // swapping R and B is its own inverse
+    { FB_FMT_RGBX8888, "RGBX8888", 4, rgbx8888_color, rgbx8888_color,  fill32, blend32 },
+    { FB_FMT_BGRX8888, "BGRX8888", 4, bgrx8888_color, bgrx8888_color,  fill32, blend32 },
+    { FB_FMT_RGB565,   "RGB565",   2, rgb565_color,   rgb565_to_color, fill16, blend16 },
+};
+
+const fb_format *fb_format_get(int id)
+{
+    if(id < 0 || id >= FB_FMT_COUNT)
+        return NULL;
+    return &formats[id];
+}
+
+int fb_format_detect(struct fb_var_screeninfo *vi)
+{
+    switch(vi->bits_per_pixel)
+    {
+        case 16:
+            if(vi->red.offset == 11 && vi->green.offset == 5 && vi->green.length == 6 && vi->blue.offset == 0)
+                return FB_FMT_RGB565;
+            break;
+        case 32:
+            if(vi->red.offset == 16 && vi->blue.offset == 0)
+                return FB_FMT_BGRX8888;
+            // some drivers don't fill in the bitfields at all
+            if(vi->red.offset != 0 || (vi->blue.offset != 16 && vi->blue.length != 0))
+                ERROR("fb: unknown 32bpp layout (r %u g %u b %u), assuming RGBX8888\n",
+                      vi->red.offset, vi->green.offset, vi->blue.offset);
+            return FB_FMT_RGBX8888;
+    }
+
+    ERROR("fb: unsupported pixel format, %u bpp\n", vi->bits_per_pixel);
+    return -1;
+}
+
+// sets bpp and bitfields of vi to describe format id
+void fb_format_set_vi(int id, struct fb_var_screeninfo *vi)
+{
+    memset(&vi->red, 0, sizeof(vi->red));
+    memset(&vi->green, 0, sizeof(vi->green));
+    memset(&vi->blue, 0, sizeof(vi->blue));
+    memset(&vi->transp, 0, sizeof(vi->transp));
+
+    switch(id)
+    {
+        case FB_FMT_RGBX8888:
+        case FB_FMT_BGRX8888:
+            vi->bits_per_pixel = 32;
+            vi->red.offset = id == FB_FMT_RGBX8888 ? 0 : 16;
+            vi->green.offset = 8;
+            vi->blue.offset = id == FB_FMT_RGBX8888 ? 16 : 0;
+            vi->transp.offset = 24;
+            vi->red.length = vi->green.length = vi->blue.length = vi->transp.length = 8;
+            break;
+        case FB_FMT_RGB565:
+            vi->bits_per_pixel = 16;
+            vi->red.offset = 11;
+            vi->red.length = 5;
+            vi->green.offset = 5;
+            vi->green.length = 6;
+            vi->blue.length = 5;
+            break;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef FB_FORMAT_H
+#define FB_FORMAT_H
+
+#include <stdint.h>
+#include <linux/fb.h>
+
+// Pixel formats the renderer can draw in. Colors passed to the framebuffer
+// API are always 0xAABBGGRR and get converted to the native pixel value.
+enum
+{
+    FB_FMT_RGBX8888, // 0xAABBGGRR
+    FB_FMT_BGRX8888, // 0xAARRGGBB, also XRGB8888/BGRA8888
+    FB_FMT_RGB565,
+
+    FB_FMT_COUNT
+};
+
+typedef struct
+{
+    int id;
+    const char *name;
+    int bpp; // bytes per pixel
+    uint32_t (*color)(uint32_t color);
+    uint32_t (*to_color)(uint32_t px); // native pixel back to 0xAABBGGRR
+    void (*fill)(void *dst, uint32_t px, int count);
+    void (*blend)(void *dst, int count);
+} fb_format;
+
+const fb_format *fb_format_get(int id);
+int fb_format_detect(struct fb_var_screeninfo *vi);
+void fb_format_set_vi(int id, struct fb_var_screeninfo *vi);
+
+#endif
@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fb_image.h"
+#include "fb_format.h"
+#include "util.h"
+#include "log.h"
+
+#define IMG_MAX_SIZE 4096
+// unused images are kept for next time until there are more of them
+#define IMG_CACHE_MAX 32
+
+#define QOI_MAGIC "qoif"
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING 8
+
+static fb_img **img_cache = NULL;
+static pthread_mutex_t img_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void fb_img_free(void *data)
+{
+    fb_img *img = (fb_img*)data;
+    if(img->map)
+        munmap(img->map, img->map_size);
+    else
+        free(img->px);
+    free(img->alpha);
+    free(img->path);
+    free(img);
+}
+
+static fb_img *fb_img_alloc(int format, int w, int h)
+{
+    const fb_format *fmt = fb_format_get(format);
+    fb_img *img = malloc(sizeof(fb_img));
+    memset(img, 0, sizeof(fb_img));
+
+    img->format = format;
+    img->w = w;
+    img->h = h;
+    img->stride = w*fmt->bpp;
+    img->px = malloc(img->stride*h);
+    return img;
+}
+
+// stores pixel i, color is 0xAABBGGRR
+static inline void fb_img_set(fb_img *img, const fb_format *fmt, int i, uint32_t color)
+{
+    uint8_t a = color >> 24;
+
+    if(fmt->bpp == 4)
+        ((uint32_t*)img->px)[i] = (*fmt->color)(color);
+    else
+    {
+        ((uint16_t*)img->px)[i] = (*fmt->color)(color);
+        if(a != 0xFF && !img->alpha)
+        {
+            img->alpha = malloc(img->w*img->h);
+            memset(img->alpha, 0xFF, i);
+        }
+        if(img->alpha)
+            img->alpha[i] = a;
+    }
+
+    if(a != 0xFF)
+        img->has_alpha = 1;
+}
+
+static inline uint32_t qoi_read32(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static fb_img *fb_img_decode_qoi(const uint8_t *data, size_t size, int format)
+{
+    const fb_format *fmt = fb_format_get(format);
+    uint8_t index[64][4];
+    uint8_t px[4] = { 0, 0, 0, 0xFF };
+    uint8_t b1, b2;
+    size_t p = QOI_HEADER_SIZE;
+    size_t end = size - QOI_PADDING;
+    int w, h, i, vg, run = 0;
+    fb_img *img;
+
+    w = qoi_read32(data + 4);
+    h = qoi_read32(data + 8);
+    if(w <= 0 || h <= 0 || w > IMG_MAX_SIZE || h > IMG_MAX_SIZE)
+        return NULL;
+
+    img = fb_img_alloc(format, w, h);
+    memset(index, 0, sizeof(index));
+
+    for(i = 0; i < w*h; ++i)
+    {
+        if(run > 0)
+            --run;
+        else if(p < end)
+        {
+            b1 = data[p++];
+            if(b1 == 0xFE)
+            {
+                if(p + 3 > end)
+                    break;
+                memcpy(px, data + p, 3);
+                p += 3;
+            }
+            else if(b1 == 0xFF)
+            {
+                if(p + 4 > end)
+                    break;
+                memcpy(px, data + p, 4);
+                p += 4;
+            }
+            else switch(b1 & 0xC0)
+            {
+                case 0x00: // index
+                    memcpy(px, index[b1], 4);
+                    break;
+                case 0x40: // diff
+                    px[0] += ((b1 >> 4) & 0x03) - 2;
+                    px[1] += ((b1 >> 2) & 0x03) - 2;
+                    px[2] += (b1 & 0x03) - 2;
+                    break;
+                case 0x80: // luma
+                    if(p >= end)
+                        goto truncated;
+                    b2 = data[p++];
+                    vg = (b1 & 0x3F) - 32;
+                    px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+                    px[1] += vg;
+                    px[2] += vg - 8 + (b2 & 0x0F);
+                    break;
+                case 0xC0: // run
+                    run = b1 & 0x3F;
+                    break;
+            }
+            memcpy(index[(px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) % 64], px, 4);
+        }
+        else
+            break;
+
+        fb_img_set(img, fmt, i, px[0] | (px[1] << 8) | (px[2] << 16) | ((uint32_t)px[3] << 24));
+    }
+
+truncated:
+    if(i != w*h)
+    {
+        fb_img_free(img);
+        return NULL;
+    }
+    return img;
+}
+
+// returns 0xAABBGGRR color of pixel i of raw image data
+static inline uint32_t fb_img_raw_color(const uint8_t *data, const fb_raw_header *hdr,
+                                        const fb_format *fmt, int i)
+{
+    if(fmt->bpp == 2)
+        return (*fmt->to_color)(((uint16_t*)data)[i]);
+
+    uint32_t px = ((uint32_t*)data)[i];
+    if(!(hdr->flags & FB_RAW_ALPHA))
+        px |= 0xFF000000;
+    return (*fmt->to_color)(px);
+}
+
+// takes ownership of the mapping if the image is in the native format
+static fb_img *fb_img_load_raw(uint8_t *map, size_t size, int format)
+{
+    fb_raw_header hdr;
+    const fb_format *src_fmt;
+    fb_img *img;
+    int i;
+
+    memcpy(&hdr, map, sizeof(hdr));
+    src_fmt = fb_format_get(hdr.format);
+    if(!src_fmt || hdr.w == 0 || hdr.h == 0 || hdr.w > IMG_MAX_SIZE || hdr.h > IMG_MAX_SIZE ||
+       size < sizeof(hdr) + hdr.w*hdr.h*src_fmt->bpp)
+    {
+        return NULL;
+    }
+
+    if((int)hdr.format == format)
+    {
+        img = malloc(sizeof(fb_img));
+        memset(img, 0, sizeof(fb_img));
+        img->format = format;
+        img->w = hdr.w;
+        img->h = hdr.h;
+        img->stride = hdr.w*src_fmt->bpp;
+        img->px = map + sizeof(hdr);
+        img->has_alpha = (hdr.flags & FB_RAW_ALPHA) && src_fmt->bpp == 4;
+        img->map = map;
+        img->map_size = size;
+        return img;
+    }
+
+    img = fb_img_alloc(format, hdr.w, hdr.h);
+    for(i = 0; i < img->w*img->h; ++i)
+        fb_img_set(img, fb_format_get(format), i, fb_img_raw_color(map + sizeof(hdr), &hdr, src_fmt, i));
+    return img;
+}
+
+static fb_img *fb_img_load(const char *path, struct stat *info, int format)
+{
+    fb_img *img = NULL;
+    uint8_t *map;
+    size_t size = info->st_size;
+    int fd;
+
+    if(size < sizeof(fb_raw_header))
+    {
+        ERROR("fb_image: %s is too small\n", path);
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        ERROR("fb_image: failed to open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        ERROR("fb_image: failed to mmap %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    if(memcmp(map, QOI_MAGIC, 4) == 0 && size >= QOI_HEADER_SIZE + QOI_PADDING)
+        img = fb_img_decode_qoi(map, size, format);
+    else if(((fb_raw_header*)map)->magic == FB_RAW_MAGIC)
+        img = fb_img_load_raw(map, size, format);
+
+    if(!img || img->map != map)
+        munmap(map, size);
+
+    if(!img)
+    {
+        ERROR("fb_image: %s is not a valid QOI or raw image\n", path);
+        return NULL;
+    }
+
+    img->path = strdup(path);
+    img->mtime = info->st_mtime;
+    return img;
+}
+
+// drops the oldest images nobody uses, img_cache_mutex must be locked
+static void fb_img_cache_trim(void)
+{
+    int i, cnt = list_item_count(img_cache);
+
+    for(i = 0; cnt > IMG_CACHE_MAX && img_cache && img_cache[i]; )
+    {
+        if(img_cache[i]->refs == 0)
+        {
+            list_rm_at(i, &img_cache, &fb_img_free);
+            --cnt;
+        }
+        else
+            ++i;
+    }
+}
+
+// Returns image in format, loaded from path or the cache. QOI files are
+// decoded once, raw ones in the native format are only mmapped.
+fb_img *fb_img_get(const char *path, int format)
+{
+    struct stat info;
+    fb_img *img;
+    int i;
+
+    if(stat(path, &info) < 0)
+        return NULL;
+
+    pthread_mutex_lock(&img_cache_mutex);
+
+    for(i = 0; img_cache && img_cache[i]; ++i)
+    {
+        img = img_cache[i];
+        if(img->stale || img->format != format || strcmp(img->path, path) != 0)
+            continue;
+
+        if(img->mtime == info.st_mtime)
+        {
+            ++img->refs;
+            pthread_mutex_unlock(&img_cache_mutex);
+            return img;
+        }
+
+        // the file has changed, items which show it keep the old one
+        if(img->refs == 0)
+            list_rm_at(i--, &img_cache, &fb_img_free);
+        else
+            img->stale = 1;
+    }
+
+    img = fb_img_load(path, &info, format);
+    if(img)
+    {
+        img->refs = 1;
+        list_add(img, &img_cache);
+        fb_img_cache_trim();
+    }
+
+    pthread_mutex_unlock(&img_cache_mutex);
+    return img;
+}
+
+void fb_img_put(fb_img *img)
+{
+    if(!img)
+        return;
+
+    pthread_mutex_lock(&img_cache_mutex);
+    if(--img->refs == 0 && img->stale)
+        list_rm(img, &img_cache, &fb_img_free);
+    pthread_mutex_unlock(&img_cache_mutex);
+}
+
+// frees all images which are not used
+void fb_img_cache_clear(void)
+{
+    int i;
+
+    pthread_mutex_lock(&img_cache_mutex);
+    for(i = 0; img_cache && img_cache[i]; )
+    {
+        if(img_cache[i]->refs == 0)
+            list_rm_at(i, &img_cache, &fb_img_free);
+        else
+            ++i;
+    }
+    pthread_mutex_unlock(&img_cache_mutex);
+}
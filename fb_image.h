@@ -0,0 +1,49 @@
+#ifndef FB_IMAGE_H
+#define FB_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// Raw images are fb_raw_header followed by h lines of w pixels in format
+// (one of FB_FMT_*). When the format is the one of the framebuffer, the
+// file is mmapped and drawn as it is, otherwise it is converted on load.
+#define FB_RAW_MAGIC 0x4D49524D // "MRIM"
+#define FB_RAW_ALPHA 0x01 // top byte of 32bpp pixels is alpha
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t w;
+    uint32_t h;
+    uint32_t format;
+    uint32_t flags;
+} fb_raw_header;
+
+// Pixels of a loaded image, in native format of the framebuffer. Images
+// are shared and cached by path and mtime, get them with fb_img_get() and
+// release with fb_img_put().
+typedef struct
+{
+    char *path;
+    time_t mtime;
+    int format;
+    int w, h;
+    int stride;     // bytes per line of px
+    uint8_t *px;
+    // 0 if all pixels are opaque. 32bpp pixels have alpha in the top
+    // byte, 16bpp ones in the alpha plane, one byte per pixel.
+    int has_alpha;
+    uint8_t *alpha;
+
+    void *map;      // mmapped raw file, px points into it
+    size_t map_size;
+    int refs;
+    int stale;      // file has changed, freed once it is not used
+} fb_img;
+
+fb_img *fb_img_get(const char *path, int format);
+void fb_img_put(fb_img *img);
+void fb_img_cache_clear(void);
+
+#endif
@@ -0,0 +1,423 @@
+#ifdef MR_FB_REMOTE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "fb_remote.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "input.h"
+#include "util.h"
+#include "log.h"
+
+// how often the server checks for new frames, it sleeps without a client
+#define POLL_MS 33
+// a client which doesn't take the data for this long is dropped
+#define SEND_TIMEOUT_S 2
+#define IN_BUF_SIZE 64
+
+static struct
+{
+    pthread_t thread;
+    volatile int run;
+    int listen_fd;
+    int client_fd;
+
+    int bpp;
+    int stride;
+    char *prev;      // last frame the client has, NULL until the first one
+    uint32_t frames; // fb_stats.frames of prev
+
+    uint8_t *out;    // FRAME message
+    uint8_t *tile;   // pixels of the encoded tile
+    uint8_t *tile_prev;
+    uint8_t *rle;
+    uint8_t *xor_rle;
+
+    uint8_t in[IN_BUF_SIZE];
+    int in_len;
+} remote = {
+    .listen_fd = -1,
+    .client_fd = -1,
+};
+
+static int send_all(int fd, const void *data, int len)
+{
+    const uint8_t *p = data;
+    int res;
+
+    while(len > 0)
+    {
+        res = send(fd, p, len, MSG_NOSIGNAL);
+        if(res < 0 && errno == EINTR)
+            continue;
+        if(res <= 0)
+            return -1;
+        p += res;
+        len -= res;
+    }
+    return 0;
+}
+
+static int send_msg(int type, const void *data, int len)
+{
+    fb_remote_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    msg.len = len;
+
+    if(send_all(remote.client_fd, &msg, sizeof(msg)) < 0)
+        return -1;
+    return send_all(remote.client_fd, data, len);
+}
+
+static inline uint32_t tile_px(const uint8_t *p, int i, int bpp)
+{
+    return bpp == 4 ? ((uint32_t*)p)[i] : ((uint16_t*)p)[i];
+}
+
+// Returns length of the RLE data or -1 if it would not be smaller than limit.
+// With xor_px set, the pixels are px ^ xor_px.
+static int rle_encode(uint8_t *out, const uint8_t *px, const uint8_t *xor_px, int cnt, int bpp, int limit)
+{
+    uint32_t val;
+    int i, run, len = 0;
+
+    for(i = 0; i < cnt; i += run)
+    {
+        if(len + 2 + bpp >= limit)
+            return -1;
+
+        val = tile_px(px, i, bpp);
+        if(xor_px)
+            val ^= tile_px(xor_px, i, bpp);
+
+        for(run = 1; i + run < cnt && run < 0xFFFF; ++run)
+        {
+            if((tile_px(px, i + run, bpp) ^ (xor_px ? tile_px(xor_px, i + run, bpp) : 0)) != val)
+                break;
+        }
+
+        out[len++] = run;
+        out[len++] = run >> 8;
+        memcpy(out + len, &val, bpp);
+        len += bpp;
+    }
+    return len;
+}
+
+// copies the tile out of the frame, returns 1 if it differs from prev
+static int tile_gather(const char *frame, const char *prev, int x, int y, int w, int h)
+{
+    const int line = w*remote.bpp;
+    int i, changed = (prev == NULL);
+    const char *src;
+
+    for(i = 0; i < h; ++i)
+    {
+        src = frame + (y + i)*remote.stride + x*remote.bpp;
+        memcpy(remote.tile + i*line, src, line);
+        if(prev)
+        {
+            memcpy(remote.tile_prev + i*line, prev + (src - frame), line);
+            changed |= memcmp(remote.tile + i*line, remote.tile_prev + i*line, line);
+        }
+    }
+    return changed;
+}
+
+static int send_frame(void)
+{
+    fb_remote_tile *t;
+    fb_stats stats;
+    char *frame;
+    uint8_t *p;
+    uint32_t cnt = 0;
+    int x, y, w, h, raw_len, rle_len, xor_len;
+
+    // stats first, a frame rendered meanwhile is sent next time
+    fb_get_stats(&stats);
+    fb_clone(&frame);
+
+    p = remote.out + sizeof(uint32_t);
+    for(y = 0; y < fb_height; y += FB_REMOTE_TILE)
+    {
+        h = imin(FB_REMOTE_TILE, fb_height - y);
+        for(x = 0; x < fb_width; x += FB_REMOTE_TILE)
+        {
+            w = imin(FB_REMOTE_TILE, fb_width - x);
+            if(!tile_gather(frame, remote.prev, x, y, w, h))
+                continue;
+
+            raw_len = w*h*remote.bpp;
+            rle_len = rle_encode(remote.rle, remote.tile, NULL, w*h, remote.bpp, raw_len);
+            xor_len = -1;
+            if(remote.prev)
+                xor_len = rle_encode(remote.xor_rle, remote.tile, remote.tile_prev, w*h, remote.bpp, rle_len >= 0 ? rle_len : raw_len);
+
+            t = (fb_remote_tile*)p;
+            memset(t, 0, sizeof(fb_remote_tile));
+            t->x = x;
+            t->y = y;
+            t->w = w;
+            t->h = h;
+            p += sizeof(fb_remote_tile);
+
+            if(xor_len >= 0)
+            {
+                t->enc = FB_REMOTE_ENC_XOR_RLE;
+                t->len = xor_len;
+                memcpy(p, remote.xor_rle, xor_len);
+            }
+            else if(rle_len >= 0)
+            {
+                t->enc = FB_REMOTE_ENC_RLE;
+                t->len = rle_len;
+                memcpy(p, remote.rle, rle_len);
+            }
+            else
+            {
+                t->enc = FB_REMOTE_ENC_RAW;
+                t->len = raw_len;
+                memcpy(p, remote.tile, raw_len);
+            }
+            p += t->len;
+            ++cnt;
+        }
+    }
+
+    free(remote.prev);
+    remote.prev = frame;
+    remote.frames = stats.frames;
+
+    // the frame was rendered, but nothing has changed
+    if(cnt == 0)
+        return 0;
+
+    memcpy(remote.out, &cnt, sizeof(cnt));
+    return send_msg(FB_REMOTE_FRAME, remote.out, p - remote.out);
+}
+
+static void client_close(void)
+{
+    if(remote.client_fd == -1)
+        return;
+
+    INFO("fb_remote: client disconnected\n");
+    close(remote.client_fd);
+    remote.client_fd = -1;
+
+    free(remote.prev);
+    free(remote.out);
+    free(remote.tile);
+    free(remote.tile_prev);
+    free(remote.rle);
+    free(remote.xor_rle);
+    remote.prev = NULL;
+    remote.out = remote.tile = remote.tile_prev = remote.rle = remote.xor_rle = NULL;
+}
+
+static void client_accept(void)
+{
+    const int tile_px_cnt = FB_REMOTE_TILE*FB_REMOTE_TILE;
+    const int tiles = ((fb_width + FB_REMOTE_TILE - 1)/FB_REMOTE_TILE)*((fb_height + FB_REMOTE_TILE - 1)/FB_REMOTE_TILE);
+    struct timeval tv = { .tv_sec = SEND_TIMEOUT_S };
+    fb_remote_hello hello;
+    int one = 1;
+
+    remote.client_fd = accept(remote.listen_fd, NULL, NULL);
+    if(remote.client_fd < 0)
+    {
+        remote.client_fd = -1;
+        return;
+    }
+
+    setsockopt(remote.client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(remote.client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    remote.bpp = fb_format_get(fb_get_format())->bpp;
+    remote.stride = fb->fi.line_length;
+    remote.in_len = 0;
+
+    // no tile is ever bigger than its raw pixels
+    remote.out = malloc(sizeof(uint32_t) + tiles*sizeof(fb_remote_tile) + fb_width*fb_height*remote.bpp);
+    remote.tile = malloc(tile_px_cnt*remote.bpp);
+    remote.tile_prev = malloc(tile_px_cnt*remote.bpp);
+    remote.rle = malloc(tile_px_cnt*remote.bpp);
+    remote.xor_rle = malloc(tile_px_cnt*remote.bpp);
+
+    INFO("fb_remote: client connected\n");
+
+    hello.w = fb_width;
+    hello.h = fb_height;
+    hello.format = fb_get_format();
+    if(send_msg(FB_REMOTE_HELLO, &hello, sizeof(hello)) < 0)
+        client_close();
+}
+
+static void handle_msg(fb_remote_msg *msg, uint8_t *data)
+{
+    fb_remote_touch touch;
+    fb_remote_key key;
+
+    switch(msg->type)
+    {
+        case FB_REMOTE_TOUCH:
+            if(msg->len != sizeof(touch))
+                break;
+            memcpy(&touch, data, sizeof(touch));
+            input_inject_touch(touch.id, touch.x, touch.y, touch.pressed);
+            break;
+        case FB_REMOTE_KEY:
+            if(msg->len != sizeof(key))
+                break;
+            memcpy(&key, data, sizeof(key));
+            input_inject_key(key.code);
+            break;
+        default:
+            ERROR("fb_remote: unknown message %d\n", msg->type);
+            break;
+    }
+}
+
+static int client_read(void)
+{
+    fb_remote_msg msg;
+    int res, used;
+
+    res = recv(remote.client_fd, remote.in + remote.in_len, IN_BUF_SIZE - remote.in_len, 0);
+    if(res <= 0)
+        return (res < 0 && errno == EINTR) ? 0 : -1;
+    remote.in_len += res;
+
+    while(remote.in_len >= (int)sizeof(msg))
+    {
+        memcpy(&msg, remote.in, sizeof(msg));
+        if(msg.len > IN_BUF_SIZE - sizeof(msg))
+        {
+            ERROR("fb_remote: message %d is too long (%u)\n", msg.type, msg.len);
+            return -1;
+        }
+
+        used = sizeof(msg) + msg.len;
+        if(remote.in_len < used)
+            break;
+
+        handle_msg(&msg, remote.in + sizeof(msg));
+        remote.in_len -= used;
+        memmove(remote.in, remote.in + used, remote.in_len);
+    }
+    return 0;
+}
+
+static void *fb_remote_thread_work(void *data)
+{
+    struct pollfd pfd;
+    fb_stats stats;
+
+    while(remote.run)
+    {
+        // other clients wait in the backlog until this one leaves
+        pfd.fd = remote.client_fd != -1 ? remote.client_fd : remote.listen_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if(poll(&pfd, 1, remote.client_fd != -1 ? POLL_MS : -1) < 0 && errno != EINTR)
+        {
+            ERROR("fb_remote: poll failed: %s\n", strerror(errno));
+            break;
+        }
+        wakeup_count();
+
+        if(remote.client_fd == -1)
+        {
+            if(remote.run && (pfd.revents & POLLIN))
+                client_accept();
+            continue;
+        }
+
+        if((pfd.revents & (POLLIN | POLLHUP | POLLERR)) && client_read() < 0)
+        {
+            client_close();
+            continue;
+        }
+
+        fb_get_stats(&stats);
+        if((!remote.prev || stats.frames != remote.frames) && send_frame() < 0)
+            client_close();
+    }
+
+    client_close();
+    return NULL;
+}
+
+int fb_remote_start(int port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+
+    if(remote.run)
+        return 0;
+
+    remote.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(remote.listen_fd < 0)
+    {
+        ERROR("fb_remote: failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    setsockopt(remote.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    // adb forward connects from the device itself
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(bind(remote.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(remote.listen_fd, 1) < 0)
+    {
+        ERROR("fb_remote: failed to listen on port %d: %s\n", port, strerror(errno));
+        close(remote.listen_fd);
+        remote.listen_fd = -1;
+        return -1;
+    }
+
+    remote.run = 1;
+    if(pthread_create(&remote.thread, NULL, fb_remote_thread_work, NULL) != 0)
+    {
+        ERROR("fb_remote: failed to start the thread\n");
+        remote.run = 0;
+        close(remote.listen_fd);
+        remote.listen_fd = -1;
+        return -1;
+    }
+
+    INFO("fb_remote: listening on port %d\n", port);
+    return 0;
+}
+
+void fb_remote_stop(void)
+{
+    if(!remote.run)
+        return;
+
+    remote.run = 0;
+    // wakes up the poll() on the listening socket
+    shutdown(remote.listen_fd, SHUT_RDWR);
+    pthread_join(remote.thread, NULL);
+
+    close(remote.listen_fd);
+    remote.listen_fd = -1;
+}
+
+#endif
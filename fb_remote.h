@@ -0,0 +1,92 @@
+#ifndef FB_REMOTE_H
+#define FB_REMOTE_H
+
+#include <stdint.h>
+
+// Remote framebuffer, build with MR_FB_REMOTE := true to enable it. The
+// server listens on 127.0.0.1 only, use adb to reach it:
+//   adb forward tcp:8787 tcp:8787
+// It serves one client at a time. All numbers are little endian.
+//
+// Every message starts with fb_remote_msg, len bytes of payload follow.
+//
+// server -> client:
+//   FB_REMOTE_HELLO  fb_remote_hello, sent right after connect
+//   FB_REMOTE_FRAME  uint32_t tile count, then the tiles, each one is
+//                    fb_remote_tile followed by its len bytes of data.
+//                    The first frame covers the whole screen, next ones
+//                    only the tiles which changed since the previous one.
+//
+// client -> server:
+//   FB_REMOTE_TOUCH  fb_remote_touch, in screen coordinates
+//   FB_REMOTE_KEY    fb_remote_key, a press and release of the key
+//
+// Tile data are pixels of the tile, line by line, in FB_FMT_* format
+// from the hello message:
+//   FB_REMOTE_ENC_RAW      w*h pixels
+//   FB_REMOTE_ENC_RLE      runs of uint16_t count followed by one pixel
+//   FB_REMOTE_ENC_XOR_RLE  like RLE, but the pixels are XORed with the
+//                          tile in the previous frame
+
+#define FB_REMOTE_PORT 8787
+#define FB_REMOTE_TILE 64
+
+enum
+{
+    FB_REMOTE_HELLO  = 1,
+    FB_REMOTE_FRAME  = 2,
+    FB_REMOTE_TOUCH  = 3,
+    FB_REMOTE_KEY    = 4,
+};
+
+enum
+{
+    FB_REMOTE_ENC_RAW      = 0,
+    FB_REMOTE_ENC_RLE      = 1,
+    FB_REMOTE_ENC_XOR_RLE  = 2,
+};
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t pad[3];
+    uint32_t len;
+} __attribute__((packed)) fb_remote_msg;
+
+typedef struct
+{
+    uint32_t w;
+    uint32_t h;
+    uint32_t format;
+} __attribute__((packed)) fb_remote_hello;
+
+typedef struct
+{
+    uint16_t x, y;
+    uint16_t w, h;
+    uint8_t enc;
+    uint8_t pad[3];
+    uint32_t len;
+} __attribute__((packed)) fb_remote_tile;
+
+typedef struct
+{
+    int32_t id;
+    int32_t x;
+    int32_t y;
+    uint32_t pressed;
+} __attribute__((packed)) fb_remote_touch;
+
+typedef struct
+{
+    uint32_t code;
+} __attribute__((packed)) fb_remote_key;
+
+#ifdef MR_FB_REMOTE
+
+int fb_remote_start(int port);
+void fb_remote_stop(void);
+
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+#ifdef MR_FB_TIMING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fb_timing.h"
+#include "log.h"
+
+// Samples are kept in a ring buffer. There is only one writer (the
+// framebuffer code pushes with fb_mutex locked), readers don't take any
+// lock, they copy the ring out and then drop samples which the writer
+// could have overwritten meanwhile.
+#define RING_SIZE 256
+
+static fb_timing_sample ring[RING_SIZE];
+static volatile uint32_t ring_head = 0; // number of pushed samples
+
+static const char *stage_names[FB_STAGE_COUNT] = {
+    "clear", "rects", "images", "texts", "overlay", "copy", "pan", "total",
+};
+
+void fb_timing_push(const fb_timing_sample *s)
+{
+    uint32_t head = ring_head;
+    ring[head % RING_SIZE] = *s;
+    __sync_synchronize();
+    ring_head = head + 1;
+}
+
+// copies newest samples to out, returns their count
+static int fb_timing_snapshot(fb_timing_sample *out)
+{
+    uint32_t head, start, valid, i;
+
+    head = ring_head;
+    __sync_synchronize();
+
+    start = head > RING_SIZE ? head - RING_SIZE : 0;
+    for(i = start; i < head; ++i)
+        out[i - start] = ring[i % RING_SIZE];
+
+    __sync_synchronize();
+
+    // writer could have been writing sample ring_head, which overwrites
+    // everything up to ring_head - RING_SIZE
+    valid = ring_head;
+    valid = valid >= RING_SIZE ? valid - RING_SIZE + 1 : 0;
+    if(valid > start)
+    {
+        if(valid >= head)
+            return 0;
+        memmove(out, out + (valid - start), (head - valid)*sizeof(fb_timing_sample));
+        start = valid;
+    }
+    return head - start;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void fb_timing_summarize_samples(fb_timing_sample *samples, int cnt, int stage, fb_timing_summary *sum)
+{
+    uint32_t vals[RING_SIZE];
+    int i;
+
+    memset(sum, 0, sizeof(fb_timing_summary));
+    if(cnt == 0)
+        return;
+
+    for(i = 0; i < cnt; ++i)
+        vals[i] = samples[i].us[stage];
+    qsort(vals, cnt, sizeof(uint32_t), cmp_u32);
+
+    sum->samples = cnt;
+    sum->p50 = vals[((cnt - 1)*50)/100];
+    sum->p95 = vals[((cnt - 1)*95)/100];
+    sum->max = vals[cnt - 1];
+}
+
+int fb_timing_summarize(int stage, fb_timing_summary *sum)
+{
+    fb_timing_sample samples[RING_SIZE];
+    int cnt;
+
+    if(stage < 0 || stage >= FB_STAGE_COUNT)
+        return -1;
+
+    cnt = fb_timing_snapshot(samples);
+    fb_timing_summarize_samples(samples, cnt, stage, sum);
+    return cnt;
+}
+
+const char *fb_timing_stage_name(int stage)
+{
+    if(stage < 0 || stage >= FB_STAGE_COUNT)
+        return "unknown";
+    return stage_names[stage];
+}
+
+void fb_timing_log(void)
+{
+    fb_timing_summary sum;
+    int i;
+
+    for(i = 0; i < FB_STAGE_COUNT; ++i)
+    {
+        if(fb_timing_summarize(i, &sum) <= 0)
+            return;
+
+        INFO("fb timing: %-8s p50 %6u us, p95 %6u us, max %6u us (%u frames)\n",
+             stage_names[i], sum.p50, sum.p95, sum.max, sum.samples);
+    }
+}
+
+int fb_timing_dump(const char *path)
+{
+    fb_timing_sample samples[RING_SIZE];
+    fb_timing_summary sum;
+    int cnt, i, x;
+    FILE *f;
+
+    f = fopen(path, "w");
+    if(!f)
+    {
+        ERROR("Failed to open %s for fb timing dump\n", path);
+        return -1;
+    }
+
+    cnt = fb_timing_snapshot(samples);
+
+    fprintf(f, "# stage p50_us p95_us max_us\n");
+    for(i = 0; i < FB_STAGE_COUNT; ++i)
+    {
+        fb_timing_summarize_samples(samples, cnt, i, &sum);
+        fprintf(f, "# %s %u %u %u\n", stage_names[i], sum.p50, sum.p95, sum.max);
+    }
+
+    for(i = 0; i < FB_STAGE_COUNT; ++i)
+        fprintf(f, "%s%s", i ? "," : "", stage_names[i]);
+    fputc('\n', f);
+
+    for(i = 0; i < cnt; ++i)
+    {
+        for(x = 0; x < FB_STAGE_COUNT; ++x)
+            fprintf(f, "%s%u", x ? "," : "", samples[i].us[x]);
+        fputc('\n', f);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef FB_TIMING_H
+#define FB_TIMING_H
+
+#include <stdint.h>
+
+// Per-frame timing of framebuffer stages, build with MR_FB_TIMING := true
+// to enable it. Without it, the macros below expand to nothing and none
+// of the functions exist.
+
+enum
+{
+    FB_STAGE_CLEAR,
+    FB_STAGE_RECTS,
+    FB_STAGE_IMAGES,
+    FB_STAGE_TEXTS,
+    FB_STAGE_OVERLAY,
+    FB_STAGE_COPY,
+    FB_STAGE_PAN,
+    FB_STAGE_TOTAL,
+
+    FB_STAGE_COUNT
+};
+
+#ifdef MR_FB_TIMING
+
+#include "util.h"
+
+typedef struct
+{
+    uint32_t us[FB_STAGE_COUNT];
+} fb_timing_sample;
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t max;
+} fb_timing_summary;
+
+// samples must be pushed from one thread at a time
+void fb_timing_push(const fb_timing_sample *s);
+int fb_timing_summarize(int stage, fb_timing_summary *sum);
+const char *fb_timing_stage_name(int stage);
+void fb_timing_log(void);
+int fb_timing_dump(const char *path);
+
+#define FB_TIMING_BEGIN(t) uint64_t t = gettime_us()
+// adds time since t to acc[stage] and restarts t
+#define FB_TIMING_LAP(acc, stage, t) do { \
+        uint64_t now_ = gettime_us(); \
+        (acc)[stage] += now_ - (t); \
+        (t) = now_; \
+    } while(0)
+
+#else
+
+#define FB_TIMING_BEGIN(t)
+#define FB_TIMING_LAP(acc, stage, t) do { } while(0)
+
+#endif
+
+#endif
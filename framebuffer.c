@@ -6,10 +6,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
+#include <malloc.h>
 #include <linux/fb.h>
 #include <linux/kd.h>
 #include <cutils/memory.h>
@@ -18,13 +20,29 @@
 #include "log.h"
 #include "framebuffer.h"
 #include "iso_font.h"
+#include "iso_font_scaled.h"
 #include "util.h"
+#include "blend.h"
+#include "workers.h"
+#include "fb_timing.h"
+#include "fb_format.h"
+#include "pool.h"
 
 static struct FB framebuffers[2];
 static int active_fb = 0;
+static int fb_pages = 2;
+// render straight into the mmapped back page instead of a shadow buffer
+static int fb_direct = 0;
+static uint8_t *shadow_bits = NULL;
+static const fb_format *fb_fmt = NULL;
+static int fb_stride = 0; // bytes per line, same for the pages and shadow buffer
+static fb_backend *backend = NULL;
+static fb_backend *default_backend = NULL;
 static int fb_frozen = 0;
 
-static fb_items_t fb_items = { NULL, NULL, NULL };
+// owned by the renderer, see fb_apply_edits()
+static fb_items_t fb_items = { NULL, NULL, NULL, NULL };
+// pushed contexts, their lists are filled in when EDIT_PUSH_CONTEXT is applied
 static fb_items_t **inactive_ctx = NULL;
 int fb_width = 0;
 int fb_height = 0;
@@ -32,7 +50,207 @@ static pthread_mutex_t fb_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct FB *fb = &framebuffers[0];
 
+#define DAMAGE_MAX 16
+
+typedef struct
+{
+    fb_bbox rects[DAMAGE_MAX];
+    int count;
+} fb_damage;
+
+// parts of the scene which have to be redrawn into fb->bits
+static fb_damage redraw_damage = { .count = 0 };
+// parts of fb->bits which changed since the last fb_update()
+static fb_damage copy_damage = { .count = 0 };
+// parts of each mapped page which are older than the last shown frame
+static fb_damage page_damage[2];
+static fb_stats stats;
+
+#define ITEM_SLAB 64
+static pool text_pool = POOL_INITIALIZER(fb_text, ITEM_SLAB);
+static pool rect_pool = POOL_INITIALIZER(fb_rect, ITEM_SLAB);
+static pool image_pool = POOL_INITIALIZER(fb_image, ITEM_SLAB);
+// texts which don't fit into fb_text.inline_text
+static volatile uint32_t text_heap_allocs = 0;
+// (re)allocations of the item lists, counted here and not in util's
+// lists, which everybody else uses too
+static uint32_t item_list_allocs = 0;
+static uint32_t last_alloc_count = 0;
+
+// Callers don't change the item lists themselves, they queue the edit and
+// the renderer applies all queued edits at the start of next frame. Adding
+// or removing items thus never waits for a frame which is being drawn.
+enum
+{
+    EDIT_ADD_TEXT,
+    EDIT_ADD_RECT,
+    EDIT_ADD_IMAGE,
+    EDIT_ADD_MSGBOX_TEXT,
+    EDIT_RM_TEXT,
+    EDIT_RM_RECT,
+    EDIT_RM_IMAGE,
+    EDIT_RM_MSGBOX_TEXT,
+    EDIT_SET_TEXT,
+    EDIT_SHOW_MSGBOX,
+    EDIT_DESTROY_MSGBOX,
+    EDIT_CLEAR,
+    EDIT_PUSH_CONTEXT,
+    EDIT_POP_CONTEXT,
+    EDIT_INVALIDATE,
+    EDIT_SCROLL,
+};
+
+typedef struct fb_edit
+{
+    struct fb_edit *next;
+    int type;
+    void *item;
+    void *target; // msgbox for EDIT_ADD_MSGBOX_TEXT
+    // new text for EDIT_SET_TEXT, points to inline_text if it fits
+    char *text;
+    char inline_text[FB_TEXT_INLINE];
+    // EDIT_SCROLL
+    fb_bbox area;
+    int dy;
+} fb_edit;
+
+static pool edit_pool = POOL_INITIALIZER(fb_edit, ITEM_SLAB);
+// lock-free stack of queued edits, newest first
+static fb_edit *volatile edit_queue = NULL;
+// msgbox as the callers see it, fb_items.msgbox changes once the edit is applied
+static fb_msgbox *volatile scene_msgbox = NULL;
+
+// Target of rasterization, everything is drawn into bits (fb->bits or
+// dim_bits), clipped to clip and the number of written pixels is added to
+// px_drawn. Each render thread has its own.
+typedef struct
+{
+    uint8_t *bits;
+    fb_bbox clip;
+    uint32_t px_drawn;
+#ifdef MR_FB_TIMING
+    uint32_t stage_us[FB_STAGE_COUNT];
+#endif
+} fb_raster;
+
+// used by the public fb_draw_* functions
+static fb_raster screen_raster;
+
+// Dimmed scene under the msgbox. It is rendered once when the box is shown
+// and then copied to the screen instead of drawing and blending everything
+// again, until something behind the box changes.
+static uint8_t *dim_bits = NULL;
+static int dim_valid = 0;
+
+// Content of area is moved by dy pixels at the start of next frame. Items
+// which moved along with it are not drawn again, only the exposed strip.
+static struct
+{
+    fb_bbox area;
+    int dy;
+} scroll;
+
+#define TILE_SIZE 64
+
+typedef struct
+{
+    fb_bbox area;
+    int first_rect, rect_cnt;
+    int first_image, image_cnt;
+    int first_text, text_cnt;
+} fb_tile;
+
+// position of tiles of one damage rect in fb_tile_frame.tiles
+typedef struct
+{
+    int base;
+    int cols;
+    int col0, row0;
+} fb_tile_grid;
+
+// damaged area split into tiles, with items which overlap each tile
+typedef struct
+{
+    fb_tile_grid grids[DAMAGE_MAX];
+    fb_tile *tiles;
+    int tile_cnt;
+    int tile_alloc;
+
+    void **items;
+    int item_alloc;
+
+    fb_raster totals[WORKERS_MAX];
+} fb_tile_frame;
+
+static fb_tile_frame tile_frame;
+static int render_threads = 1;
+
+#ifdef MR_FB_TIMING
+// stages of the frame which is being drawn, pushed in fb_present()
+static fb_timing_sample frame_timing;
+static uint64_t frame_start;
+#endif
+
+#define FB_MIN_HZ 20
+#define FB_MAX_HZ 120
+
+// Frames are rendered by the render thread, fb_draw() only requests them.
+// Requests which come before the thread gets to them are merged into one
+// frame and at most one frame is rendered per refresh interval.
+static struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t request_cond;
+    pthread_cond_t done_cond;
+    int running;
+    int quit;
+    int pending;
+    int rendering;
+    int flushing;
+    uint32_t interval_us;
+    uint64_t last_frame;
+    uint32_t frames_requested;
+} render = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .request_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+#define GLYPH_COUNT (sizeof(iso_font)/ISO_CHAR_HEIGHT)
+
 void fb_destroy_item(void *item); // private!
+static void fb_present(void);
+static void fb_start_render_thread(struct fb_var_screeninfo *vi);
+static void fb_stop_render_thread(void);
+static void fb_push_edit(fb_edit *e);
+static void fb_queue_edit(int type, void *item);
+static void fb_apply_edits(void);
+
+// Rasterization works on native pixels. The inner loops are written once
+// with bpp as a parameter and always inlined with a constant, so each pixel
+// size gets its own specialized copy.
+#define FB_SPECIALIZE static inline __attribute__((always_inline))
+
+FB_SPECIALIZE void fill_px(uint8_t *dst, uint32_t px, int count, const int bpp)
+{
+    if(bpp == 4)
+        android_memset32((uint32_t*)dst, px, count*4);
+    else
+        android_memset16((uint16_t*)dst, px, count*2);
+}
+
+static inline uint32_t fb_px(uint32_t color)
+{
+    return (*fb_fmt->color)(color);
+}
+
+static void fb_fill_lines(uint8_t *bits, int lines, uint32_t px)
+{
+    int i;
+    for(i = 0; i < lines; ++i, bits += fb_stride)
+        (*fb_fmt->fill)(bits, px, fb_width);
+}
 
 int vt_set_mode(int graphics)
 {
@@ -52,86 +270,544 @@ struct FB *get_active_fb()
     return &framebuffers[active_fb];
 }
 
-int fb_open(void)
+static inline int bbox_empty(fb_bbox *b)
 {
-    int fd = open("/dev/graphics/fb0", O_RDWR);
-    if (fd < 0)
-        return -1;
+    return b->w <= 0 || b->h <= 0;
+}
+
+static int bbox_intersect(fb_bbox *a, fb_bbox *b, fb_bbox *res)
+{
+    int x1 = imax(a->x, b->x);
+    int y1 = imax(a->y, b->y);
+    int x2 = imin(a->x + a->w, b->x + b->w);
+    int y2 = imin(a->y + a->h, b->y + b->h);
+
+    res->x = x1;
+    res->y = y1;
+    res->w = x2 - x1;
+    res->h = y2 - y1;
+    return !bbox_empty(res);
+}
+
+static void bbox_union(fb_bbox *a, fb_bbox *b, fb_bbox *res)
+{
+    int x1 = imin(a->x, b->x);
+    int y1 = imin(a->y, b->y);
+    int x2 = imax(a->x + a->w, b->x + b->w);
+    int y2 = imax(a->y + a->h, b->y + b->h);
+
+    res->x = x1;
+    res->y = y1;
+    res->w = x2 - x1;
+    res->h = y2 - y1;
+}
+
+static inline int bbox_inside(fb_bbox *a, fb_bbox *area)
+{
+    return a->x >= area->x && a->y >= area->y &&
+           a->x + a->w <= area->x + area->w && a->y + a->h <= area->y + area->h;
+}
+
+static inline int bbox_touches(fb_bbox *a, fb_bbox *b)
+{
+    return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+           a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+static void damage_add(fb_damage *d, fb_bbox *area)
+{
+    fb_bbox screen = { 0, 0, fb_width, fb_height };
+    fb_bbox b;
+    int i;
+
+    if(!bbox_intersect(area, &screen, &b))
+        return;
+
+    // merge with everything it overlaps, the merged rect might now
+    // overlap some other rect, so start over
+    for(i = 0; i < d->count; ++i)
+    {
+        if(!bbox_touches(&b, &d->rects[i]))
+            continue;
+
+        bbox_union(&b, &d->rects[i], &b);
+        d->rects[i] = d->rects[--d->count];
+        i = -1;
+    }
+
+    if(d->count == DAMAGE_MAX)
+    {
+        // too fragmented, collapse everything into one rect
+        for(i = 0; i < d->count; ++i)
+            bbox_union(&b, &d->rects[i], &b);
+        d->count = 0;
+    }
+
+    d->rects[d->count++] = b;
+}
+
+static void damage_add_all(fb_damage *dst, fb_damage *src)
+{
+    int i;
+    for(i = 0; i < src->count; ++i)
+        damage_add(dst, &src->rects[i]);
+}
+
+static void damage_full(fb_damage *d)
+{
+    fb_bbox screen = { 0, 0, fb_width, fb_height };
+    d->count = 0;
+    damage_add(d, &screen);
+}
+
+// Removes area from d, parts of rects around it are kept. The parts touch
+// each other, so they are not merged like in damage_add() while there is
+// space for them.
+static void damage_subtract(fb_damage *d, fb_bbox *area)
+{
+    fb_damage src = *d;
+    fb_bbox parts[4];
+    fb_bbox *r, b;
+    int i, p;
+
+    d->count = 0;
+    for(i = 0; i < src.count; ++i)
+    {
+        r = &src.rects[i];
+        if(!bbox_intersect(r, area, &b))
+        {
+            parts[0] = *r;
+            p = 1;
+        }
+        else
+        {
+            // above, below, left and right of the intersection
+            parts[0] = (fb_bbox){ r->x, r->y, r->w, b.y - r->y };
+            parts[1] = (fb_bbox){ r->x, b.y + b.h, r->w, r->y + r->h - b.y - b.h };
+            parts[2] = (fb_bbox){ r->x, b.y, b.x - r->x, b.h };
+            parts[3] = (fb_bbox){ b.x + b.w, b.y, r->x + r->w - b.x - b.w, b.h };
+            p = 4;
+        }
+
+        while(p--)
+        {
+            if(bbox_empty(&parts[p]))
+                continue;
+            if(d->count < DAMAGE_MAX)
+                d->rects[d->count++] = parts[p];
+            else
+                damage_add(d, &parts[p]);
+        }
+    }
+}
+
+static inline uint32_t hash_add(uint32_t h, uint32_t val)
+{
+    // FNV-1a
+    return (h ^ val) * 16777619;
+}
+
+static void fb_text_bbox(fb_text *t, fb_bbox *b)
+{
+    int c_width = ISO_CHAR_WIDTH * t->size;
+    int c_height = ISO_CHAR_HEIGHT * t->size;
+    int x = 0, y = 0, max_x = 0, max_y = 0;
+    int i;
+
+    for(i = 0; t->text[i] != 0; ++i)
+    {
+        switch(t->text[i])
+        {
+            case '\n':
+                y += c_height;
+                x = 0;
+                continue;
+            case '\r':
+                x = 0;
+                continue;
+            case '\f':
+                x = y = 0;
+                continue;
+        }
+        x += c_width;
+        max_x = imax(max_x, x);
+        max_y = imax(max_y, y + c_height);
+    }
+
+    b->x = t->head.x;
+    b->y = t->head.y;
+    b->w = max_x;
+    b->h = max_y;
+}
+
+// full are bounds of the whole item, b only of the part inside its clip
+static void fb_item_state(fb_item_header *h, fb_bbox *full, fb_bbox *b, uint32_t *hash)
+{
+    uint32_t res = 2166136261U;
+    int i;
+
+    switch(h->type)
+    {
+        case FB_TEXT:
+        {
+            fb_text *t = (fb_text*)h;
+            fb_text_bbox(t, full);
+            res = hash_add(res, t->color);
+            res = hash_add(res, t->size);
+            for(i = 0; t->text[i]; ++i)
+                res = hash_add(res, (uint8_t)t->text[i]);
+            break;
+        }
+        case FB_RECT:
+        {
+            fb_rect *r = (fb_rect*)h;
+            full->x = r->head.x;
+            full->y = r->head.y;
+            full->w = r->w;
+            full->h = r->h;
+            res = hash_add(res, r->color);
+            break;
+        }
+        case FB_IMG:
+        {
+            fb_image *im = (fb_image*)h;
+            full->x = im->head.x;
+            full->y = im->head.y;
+            full->w = imin(im->w, im->img->w);
+            full->h = imin(im->h, im->img->h);
+            res = hash_add(res, (uint32_t)(uintptr_t)im->img);
+            break;
+        }
+        default:
+            memset(full, 0, sizeof(fb_bbox));
+            break;
+    }
+    *hash = res;
+
+    *b = *full;
+    if(h->clip && !bbox_intersect(full, h->clip, b))
+        memset(b, 0, sizeof(fb_bbox));
+}
+
+static void fb_item_reset_state(fb_item_header *h)
+{
+    memset(&h->drawn, 0, sizeof(fb_bbox));
+    memset(&h->drawn_full, 0, sizeof(fb_bbox));
+    h->drawn_hash = 0;
+}
 
+// compares item against its last drawn state, must be called with fb_mutex locked
+// returns 1 if the item has changed since it was drawn
+static int fb_item_damage(fb_item_header *h)
+{
+    fb_bbox full, b;
+    uint32_t hash;
+
+    fb_item_state(h, &full, &b, &hash);
+
+    // the full bounds matter too, a clipped item can move and still
+    // cover the same part of its clip
+    if(hash == h->drawn_hash && memcmp(&b, &h->drawn, sizeof(fb_bbox)) == 0 &&
+       memcmp(&full, &h->drawn_full, sizeof(fb_bbox)) == 0)
+    {
+        return 0;
+    }
+
+    damage_add(&redraw_damage, &h->drawn);
+    damage_add(&redraw_damage, &b);
+
+    h->drawn = b;
+    h->drawn_full = full;
+    h->drawn_hash = hash;
+    return 1;
+}
+
+// list_rm moves the last item into the removed slot, which changes the
+// drawing order - damage the moved item too
+static void fb_item_damage_rm(void *item, void **list)
+{
+    fb_item_header *h = (fb_item_header*)item;
+    int cnt = list_item_count(list);
+
+    damage_add(&redraw_damage, &h->drawn);
+    if(cnt > 1 && list[cnt-1] != item)
+        damage_add(&redraw_damage, &((fb_item_header*)list[cnt-1])->drawn);
+}
+
+void fb_invalidate(void)
+{
+    fb_queue_edit(EDIT_INVALIDATE, NULL);
+}
+
+void fb_scroll(int x, int y, int w, int h, int dy)
+{
+    if(dy == 0)
+        return;
+
+    fb_edit *e = pool_alloc(&edit_pool);
+    e->type = EDIT_SCROLL;
+    e->area.x = x;
+    e->area.y = y;
+    e->area.w = w;
+    e->area.h = h;
+    e->dy = dy;
+    fb_push_edit(e);
+}
+
+void fb_get_stats(fb_stats *s)
+{
+    pthread_mutex_lock(&fb_mutex);
+    *s = stats;
+    pthread_mutex_unlock(&fb_mutex);
+
+    pthread_mutex_lock(&render.lock);
+    s->frames_requested = render.frames_requested;
+    pthread_mutex_unlock(&render.lock);
+}
+
+uint64_t fb_next_frame_time(void)
+{
+    uint64_t res = 0;
+
+    pthread_mutex_lock(&render.lock);
+    if(render.running)
+        res = render.last_frame + render.interval_us;
+    pthread_mutex_unlock(&render.lock);
+    return res;
+}
+
+void fb_set_backend(fb_backend *b)
+{
+    backend = b;
+}
+
+int fb_open(void)
+{
     struct fb_fix_screeninfo fi;
     struct fb_var_screeninfo vi;
 
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &fi) < 0)
-        goto fail;
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &vi) < 0)
-        goto fail;
+    if(!backend)
+    {
+        if(!default_backend)
+            default_backend = fb_backend_fbdev(NULL);
+        backend = default_backend;
+    }
+
+    uint8_t *bits = (*backend->open)(backend, &vi, &fi);
+    if(!bits)
+        return -1;
+
+    int format = fb_format_detect(&vi);
+    if(format < 0)
+    {
+        (*backend->close)(backend, bits, &fi);
+        return -1;
+    }
 
-    uint32_t *bits = mmap(0, fi.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    fb_fmt = fb_format_get(format);
+    fb_stride = fi.line_length;
+    fb_pages = (vi.yres_virtual >= vi.yres*2 && fi.smem_len >= vi.yres*fi.line_length*2) ? 2 : 1;
+    fb_direct = (fb_pages == 2);
 
-    if (bits == MAP_FAILED)
-        goto fail;
+    blend_init();
 
     fb_width = vi.xres;
     fb_height = vi.yres;
     fb_frozen = 0;
     active_fb = 0;
 
-    uint32_t *b_store = malloc(vi.xres*vi.yres*4);
-    android_memset32(b_store, BLACK, vi.xres*vi.yres*4);
+    screen_raster.clip.x = screen_raster.clip.y = 0;
+    screen_raster.clip.w = fb_width;
+    screen_raster.clip.h = fb_height;
+    dim_valid = 0;
+    scroll.dy = 0;
+    damage_full(&redraw_damage);
+    damage_full(&copy_damage);
+    damage_full(&page_damage[0]);
+    damage_full(&page_damage[1]);
 
-    fb = &framebuffers[0];
-    fb->fd = fd;
-    fb->size = vi.xres*vi.yres*4;
-    fb->vi = vi;
-    fb->fi = fi;
-    fb->bits = b_store;
-    fb->mapped = bits;
+    shadow_bits = NULL;
+    if(!fb_direct)
+        shadow_bits = malloc(vi.yres*fi.line_length);
 
-    ++fb;
+    int i;
+    for(i = 0; i < 2; ++i)
+    {
+        fb = &framebuffers[i];
+        fb->fd = backend->fd;
+        fb->size = vi.yres*fi.line_length;
+        fb->vi = vi;
+        fb->fi = fi;
+        fb->mapped = bits + (i % fb_pages) * vi.yres * fi.line_length;
+        fb->bits = fb_direct ? fb->mapped : shadow_bits;
+    }
 
-    fb->fd = fd;
-    fb->size = vi.xres*vi.yres*4;
-    fb->vi = vi;
-    fb->fi = fi;
-    fb->bits = b_store;
-    fb->mapped = (void*) (((unsigned) bits) + vi.yres * fi.line_length);
+    fb = &framebuffers[fb_pages == 2 ? 1 : 0];
+    screen_raster.bits = fb->bits;
+    fb_fill_lines(fb->bits, fb_height, fb_px(BLACK));
 
-    --fb;
+    INFO("fb: %s %ux%u %s, stride %d, %d page(s), rendering %s\n", backend->name, vi.xres, vi.yres,
+         fb_fmt->name, fb_stride, fb_pages, fb_direct ? "directly into back page" : "into shadow buffer");
 
     fb_update();
 
-    return 0;
+    if(render_threads > 1)
+        workers_start(render_threads);
 
-fail:
-    close(fd);
-    return -1;
+    fb_start_render_thread(&vi);
+
+    return 0;
 }
 
 void fb_close(void)
 {
-    munmap(fb->mapped, fb->fi.smem_len);
-    close(fb->fd);
-    free(fb->bits);
+    fb_stop_render_thread();
+    workers_stop();
+
+    // frees items of edits queued after the last frame
+    pthread_mutex_lock(&fb_mutex);
+    fb_apply_edits();
+    pthread_mutex_unlock(&fb_mutex);
+
+#ifdef MR_FB_TIMING
+    fb_timing_log();
+#endif
+    (*backend->close)(backend, framebuffers[0].mapped, &fb->fi);
+    free(shadow_bits);
+    shadow_bits = NULL;
+    free(dim_bits);
+    dim_bits = NULL;
 }
 
 void fb_set_active_framebuffer(unsigned n)
 {
     if (n > 1) return;
-    fb->vi.yres_virtual = fb->vi.yres * 4;
-    fb->vi.yoffset = n * fb->vi.yres;
-    fb->vi.bits_per_pixel = 4 * 8;
-    if (ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->vi) < 0) {
+    if ((*backend->set_page)(backend, &fb->vi, n) < 0) {
         ERROR("active fb swap failed");
     }
 }
 
-void fb_update(void)
+static inline int fb_back_page(void)
+{
+    return fb_pages == 2 ? !active_fb : active_fb;
+}
+
+// Shows content of fb->bits, copy_damage must contain all parts changed
+// since last call. Must be called with fb_mutex locked.
+static void fb_present(void)
+{
+    int back = fb_back_page();
+    FB_TIMING_BEGIN(t);
+
+    stats.px_copied = 0;
+
+    if(!fb_direct)
+    {
+        // back page is also missing whatever changed while it was shown
+        fb_damage d = copy_damage;
+        damage_add_all(&d, &page_damage[back]);
+
+        uint8_t *mapped = framebuffers[back].mapped;
+        uint8_t *src, *dst;
+        fb_bbox *b;
+        int i, y, offset;
+
+        for(i = 0; i < d.count; ++i)
+        {
+            b = &d.rects[i];
+            offset = b->y*fb_stride + b->x*fb_fmt->bpp;
+            src = fb->bits + offset;
+            dst = mapped + offset;
+            for(y = 0; y < b->h; ++y)
+            {
+                memcpy(dst, src, b->w*fb_fmt->bpp);
+                src += fb_stride;
+                dst += fb_stride;
+            }
+            stats.px_copied += b->w*b->h;
+        }
+        stats.px_copied_total += stats.px_copied;
+        FB_TIMING_LAP(frame_timing.us, FB_STAGE_COPY, t);
+    }
+
+    page_damage[back].count = 0;
+
+    if(fb_pages == 2)
+    {
+        damage_add_all(&page_damage[active_fb], &copy_damage);
+        active_fb = back;
+        fb_set_active_framebuffer(active_fb);
+        FB_TIMING_LAP(frame_timing.us, FB_STAGE_PAN, t);
+
+        if(fb_direct)
+        {
+            fb = &framebuffers[fb_back_page()];
+            screen_raster.bits = fb->bits;
+        }
+    }
+
+    copy_damage.count = 0;
+
+#ifdef MR_FB_TIMING
+    frame_timing.us[FB_STAGE_TOTAL] = gettime_us() - frame_start;
+    fb_timing_push(&frame_timing);
+    memset(&frame_timing, 0, sizeof(frame_timing));
+#endif
+}
+
+// Moves pixels of scroll.area in fb->bits, must be called with fb_mutex
+// locked. Rows which would come from outside of the area are left as
+// they are, fb_apply_scroll() has damaged them.
+static void fb_scroll_pixels(void)
 {
-    active_fb = !active_fb;
+    fb_bbox *a = &scroll.area;
+    int dy = scroll.dy;
+    uint8_t *src = fb->bits;
+    size_t offset = a->x*fb_fmt->bpp;
+    size_t len = a->w*fb_fmt->bpp;
+    int y, y_end, step;
+
+    scroll.dy = 0;
+    if(dy == 0)
+        return;
+
+    if(fb_direct)
+    {
+        // the back page is older than the shown one, which has everything
+        // that was drawn so far. Area in the back page is then up to date.
+        src = framebuffers[active_fb].mapped;
+        damage_subtract(&page_damage[fb_back_page()], a);
+    }
+
+    // go against the direction of the move, so that rows are not
+    // overwritten before they are copied
+    if(dy > 0)
+    {
+        y = a->y + a->h - 1;
+        y_end = a->y + dy - 1;
+        step = -1;
+    }
+    else
+    {
+        y = a->y;
+        y_end = a->y + a->h + dy;
+        step = 1;
+    }
 
-    memcpy(get_active_fb()->mapped, fb->bits, fb->size);
+    for(; (y - y_end)*step < 0; y += step)
+        memcpy(fb->bits + y*fb_stride + offset, src + (y - dy)*fb_stride + offset, len);
+
+    damage_add(&copy_damage, a);
+}
 
-    fb_set_active_framebuffer(active_fb);
+void fb_update(void)
+{
+    pthread_mutex_lock(&fb_mutex);
+#ifdef MR_FB_TIMING
+    frame_start = gettime_us();
+#endif
+    fb_present();
+    pthread_mutex_unlock(&fb_mutex);
 }
 
 int fb_clone(char **buff)
@@ -139,29 +815,713 @@ int fb_clone(char **buff)
     int len = fb_size(fb);
     *buff = malloc(len);
 
+    fb_flush();
+
     pthread_mutex_lock(&fb_mutex);
-    memcpy(*buff, fb->bits, len);
+    // in direct mode, fb->bits is the back page
+    memcpy(*buff, fb_direct ? get_active_fb()->mapped : fb->bits, len);
     pthread_mutex_unlock(&fb_mutex);
 
     return len;
 }
 
+int fb_get_format(void)
+{
+    return fb_fmt ? fb_fmt->id : -1;
+}
+
 void fb_fill(uint32_t color)
 {
-    android_memset32(fb->bits, color, fb->size);
+    pthread_mutex_lock(&fb_mutex);
+    fb_fill_lines(fb->bits, fb_height, fb_px(color));
+    damage_full(&redraw_damage);
+    damage_full(&copy_damage);
+    pthread_mutex_unlock(&fb_mutex);
 }
 
-void fb_draw_text(fb_text *t)
+void fb_remove_item(void *item)
 {
-    int c_width = ISO_CHAR_WIDTH * t->size;
-    int c_height = ISO_CHAR_HEIGHT * t->size; 
+    switch(((fb_item_header*)item)->type)
+    {
+        case FB_TEXT:
+            fb_rm_text((fb_text*)item);
+            break;
+        case FB_RECT:
+            fb_rm_rect((fb_rect*)item);
+            break;
+        case FB_IMG:
+            fb_rm_image((fb_image*)item);
+            break;
+        case FB_BOX:
+            // fb_destroy_msgbox must be used
+            assert(0);
+            break;
+    }
+}
 
-    int linelen = fb_width/(c_width);
-    int x = t->head.x;
-    int y = t->head.y;
+static void fb_text_free(fb_text *t)
+{
+    if(t->text != t->inline_text)
+        free(t->text);
+}
 
-    int i;
-    for(i = 0; t->text[i] != 0; ++i)
+// returns copy of txt, which is put to inline_buf if it fits
+static char *fb_text_dup(char *inline_buf, const char *txt)
+{
+    char *res = inline_buf;
+    size_t len = strlen(txt)+1;
+    if(len > FB_TEXT_INLINE)
+    {
+        res = malloc(len);
+        __sync_fetch_and_add(&text_heap_allocs, 1);
+    }
+    memcpy(res, txt, len);
+    return res;
+}
+
+void fb_destroy_item(void *item)
+{
+    switch(((fb_item_header*)item)->type)
+    {
+        case FB_TEXT:
+            fb_text_free((fb_text*)item);
+            pool_free(&text_pool, item);
+            break;
+        case FB_RECT:
+            pool_free(&rect_pool, item);
+            break;
+        case FB_IMG:
+            fb_img_put(((fb_image*)item)->img);
+            pool_free(&image_pool, item);
+            break;
+        case FB_BOX:
+            // fb_destroy_msgbox must be used
+            assert(0);
+            break;
+    }
+}
+
+// heap allocations made for items and item lists so far
+static uint32_t fb_alloc_count(void)
+{
+    return text_pool.heap_allocs + rect_pool.heap_allocs + image_pool.heap_allocs + edit_pool.heap_allocs +
+           text_heap_allocs + item_list_allocs;
+}
+
+static void fb_push_edit(fb_edit *e)
+{
+    fb_edit *head;
+    do
+    {
+        head = edit_queue;
+        e->next = head;
+    }
+    while(!__sync_bool_compare_and_swap(&edit_queue, head, e));
+}
+
+static void fb_queue_edit(int type, void *item)
+{
+    fb_edit *e = pool_alloc(&edit_pool);
+    e->type = type;
+    e->item = item;
+    fb_push_edit(e);
+}
+
+static inline size_t fb_list_alloc_size(void **list)
+{
+    return list ? malloc_usable_size(list) : 0;
+}
+
+// util's lists are reallocated only when their capacity changes, which
+// shows in the block they get
+static void fb_list_count_alloc(void **before, size_t before_size, void *list_p)
+{
+    void **after = *((void***)list_p);
+    if(after && (after != before || malloc_usable_size(after) != before_size))
+        ++item_list_allocs;
+}
+
+static void fb_add_to(void *item, void *list_p)
+{
+    void **list = *((void***)list_p);
+    size_t size = fb_list_alloc_size(list);
+
+    list_add(item, list_p);
+    fb_list_count_alloc(list, size, list_p);
+}
+
+static void fb_rm_from(void *item, void *list_p)
+{
+    void **list = *((void***)list_p);
+    size_t size = fb_list_alloc_size(list);
+
+    fb_item_damage_rm(item, list);
+    list_rm(item, list_p, &fb_destroy_item);
+    fb_list_count_alloc(list, size, list_p);
+}
+
+// items which are moved by the scroll with their pixels keep their drawn
+// state, others get damaged where their pixels were and where they went
+static void fb_scroll_items(void **items, fb_bbox *area, int dy)
+{
+    fb_item_header *h;
+    fb_bbox moved, b;
+    int i;
+
+    for(i = 0; items && items[i]; ++i)
+    {
+        h = (fb_item_header*)items[i];
+        if(!bbox_intersect(&h->drawn, area, &b))
+            continue;
+
+        moved = h->drawn;
+        moved.y += dy;
+
+        if(h->clip && memcmp(h->clip, area, sizeof(fb_bbox)) == 0)
+        {
+            // clipped to the scrolled area, the part which comes into
+            // view is in the exposed strip
+            h->drawn_full.y += dy;
+            if(!bbox_intersect(&h->drawn_full, area, &h->drawn))
+                memset(&h->drawn, 0, sizeof(fb_bbox));
+        }
+        else if(bbox_inside(&h->drawn, area) && bbox_inside(&moved, area))
+        {
+            h->drawn = moved;
+            h->drawn_full.y += dy;
+        }
+        else
+        {
+            damage_add(&redraw_damage, &h->drawn);
+            if(bbox_intersect(&moved, area, &b))
+                damage_add(&redraw_damage, &b);
+        }
+    }
+}
+
+// must be called with fb_mutex locked
+static void fb_apply_scroll(fb_edit *e)
+{
+    fb_bbox screen = { 0, 0, fb_width, fb_height };
+    fb_bbox area, b;
+    fb_damage stale;
+    int i;
+
+    if(!bbox_intersect(&e->area, &screen, &area))
+        return;
+
+    dim_valid = 0;
+
+    // the dimmed background is not moved, and only one area can be
+    // scrolled per frame
+    if(fb_items.msgbox || (scroll.dy != 0 && memcmp(&area, &scroll.area, sizeof(fb_bbox)) != 0))
+    {
+        damage_add(&redraw_damage, &area);
+        return;
+    }
+
+    // whatever was not drawn yet is moved too
+    stale = redraw_damage;
+    for(i = 0; i < stale.count; ++i)
+    {
+        if(!bbox_intersect(&stale.rects[i], &area, &b))
+            continue;
+        b.y += e->dy;
+        if(bbox_intersect(&b, &area, &b))
+            damage_add(&redraw_damage, &b);
+    }
+
+    fb_scroll_items((void**)fb_items.rects, &area, e->dy);
+    fb_scroll_items((void**)fb_items.images, &area, e->dy);
+    fb_scroll_items((void**)fb_items.texts, &area, e->dy);
+
+    // exposed strip
+    b = area;
+    if(e->dy > 0)
+        b.h = imin(e->dy, area.h);
+    else
+    {
+        b.h = imin(-e->dy, area.h);
+        b.y = area.y + area.h - b.h;
+    }
+    damage_add(&redraw_damage, &b);
+
+    scroll.area = area;
+    scroll.dy += e->dy;
+}
+
+// must be called with fb_mutex locked
+static void fb_apply_edit(fb_edit *e)
+{
+    fb_msgbox *box;
+    fb_items_t *ctx;
+    fb_text *t;
+
+    switch(e->type)
+    {
+        case EDIT_ADD_TEXT:
+            fb_add_to(e->item, &fb_items.texts);
+            break;
+        case EDIT_ADD_RECT:
+            fb_add_to(e->item, &fb_items.rects);
+            break;
+        case EDIT_ADD_IMAGE:
+            fb_add_to(e->item, &fb_items.images);
+            break;
+        case EDIT_ADD_MSGBOX_TEXT:
+            box = (fb_msgbox*)e->target;
+            fb_add_to(e->item, &box->texts);
+            break;
+        case EDIT_RM_TEXT:
+            fb_rm_from(e->item, &fb_items.texts);
+            dim_valid = 0;
+            break;
+        case EDIT_RM_RECT:
+            fb_rm_from(e->item, &fb_items.rects);
+            dim_valid = 0;
+            break;
+        case EDIT_RM_IMAGE:
+            fb_rm_from(e->item, &fb_items.images);
+            dim_valid = 0;
+            break;
+        case EDIT_RM_MSGBOX_TEXT:
+            if(fb_items.msgbox)
+                fb_rm_from(e->item, &fb_items.msgbox->texts);
+            break;
+        case EDIT_SET_TEXT:
+            t = (fb_text*)e->item;
+            if(strcmp(t->text, e->text) == 0)
+            {
+                if(e->text != e->inline_text)
+                    free(e->text);
+                break;
+            }
+
+            fb_text_free(t);
+            if(e->text == e->inline_text)
+                t->text = fb_text_dup(t->inline_text, e->text);
+            else
+                t->text = e->text;
+            break;
+        case EDIT_SHOW_MSGBOX:
+            fb_items.msgbox = (fb_msgbox*)e->item;
+            // the overlay dims whole screen
+            damage_full(&redraw_damage);
+            dim_valid = 0;
+            break;
+        case EDIT_DESTROY_MSGBOX:
+            box = (fb_msgbox*)e->item;
+            if(fb_items.msgbox == box)
+                fb_items.msgbox = NULL;
+            list_clear(&box->texts, &fb_destroy_item);
+            free(box);
+            damage_full(&redraw_damage);
+            dim_valid = 0;
+            break;
+        case EDIT_CLEAR:
+            list_clear(&fb_items.texts, &fb_destroy_item);
+            list_clear(&fb_items.rects, &fb_destroy_item);
+            list_clear(&fb_items.images, &fb_destroy_item);
+            damage_full(&redraw_damage);
+            dim_valid = 0;
+            break;
+        case EDIT_PUSH_CONTEXT:
+            ctx = (fb_items_t*)e->item;
+            list_move(&fb_items.texts, &ctx->texts);
+            list_move(&fb_items.rects, &ctx->rects);
+            list_move(&fb_items.images, &ctx->images);
+            fb_items.msgbox = NULL;
+            damage_full(&redraw_damage);
+            dim_valid = 0;
+            break;
+        case EDIT_POP_CONTEXT:
+            ctx = (fb_items_t*)e->item;
+            list_move(&ctx->texts, &fb_items.texts);
+            list_move(&ctx->rects, &fb_items.rects);
+            list_move(&ctx->images, &fb_items.images);
+            fb_items.msgbox = ctx->msgbox;
+            free(ctx);
+            damage_full(&redraw_damage);
+            dim_valid = 0;
+            break;
+        case EDIT_INVALIDATE:
+            damage_full(&redraw_damage);
+            dim_valid = 0;
+            break;
+        case EDIT_SCROLL:
+            fb_apply_scroll(e);
+            break;
+    }
+}
+
+// Applies queued edits in the order they were made, must be called with
+// fb_mutex locked. The whole stack is taken at once, so the producers never
+// race with the renderer for a single node.
+static void fb_apply_edits(void)
+{
+    fb_edit *e = __sync_lock_test_and_set(&edit_queue, NULL);
+    fb_edit *fifo = NULL;
+    fb_edit *next;
+
+    for(; e; e = next)
+    {
+        next = e->next;
+        e->next = fifo;
+        fifo = e;
+    }
+
+    for(e = fifo; e; e = next)
+    {
+        next = e->next;
+        fb_apply_edit(e);
+        pool_free(&edit_pool, e);
+    }
+}
+
+int fb_generate_item_id()
+{
+    static volatile int id = 0;
+    return __sync_fetch_and_add(&id, 1);
+}
+
+static fb_text *fb_create_text_item(int x, int y, uint32_t color, int size, const char *txt)
+{
+    fb_text *t = pool_alloc(&text_pool);
+    t->head.id = fb_generate_item_id();
+    t->head.type = FB_TEXT;
+    t->head.x = x;
+    t->head.y = y;
+
+    fb_item_reset_state(&t->head);
+
+    t->color = color;
+    t->size = size;
+    t->text = fb_text_dup(t->inline_text, txt);
+
+    return t;
+}
+
+// t->text keeps the old value until next frame
+void fb_text_set(fb_text *t, const char *text)
+{
+    fb_edit *e = pool_alloc(&edit_pool);
+    e->type = EDIT_SET_TEXT;
+    e->item = t;
+    e->text = fb_text_dup(e->inline_text, text);
+    fb_push_edit(e);
+}
+
+fb_text *fb_add_text(int x, int y, uint32_t color, int size, const char *fmt, ...)
+{
+    char txt[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(txt, sizeof(txt), fmt, ap);
+    va_end(ap);
+
+    return fb_add_text_long(x, y, color, size, txt);
+}
+
+fb_text *fb_add_text_long(int x, int y, uint32_t color, int size, char *text)
+{
+    return fb_add_text_clipped(NULL, x, y, color, size, text);
+}
+
+fb_text *fb_add_text_clipped(fb_bbox *clip, int x, int y, uint32_t color, int size, const char *text)
+{
+    fb_text *t = fb_create_text_item(x, y, color, size, text);
+    t->head.clip = clip;
+    fb_queue_edit(EDIT_ADD_TEXT, t);
+    return t;
+}
+
+fb_rect *fb_add_rect(int x, int y, int w, int h, uint32_t color)
+{
+    return fb_add_rect_clipped(NULL, x, y, w, h, color);
+}
+
+fb_rect *fb_add_rect_clipped(fb_bbox *clip, int x, int y, int w, int h, uint32_t color)
+{
+    fb_rect *r = pool_alloc(&rect_pool);
+    r->head.id = fb_generate_item_id();
+    r->head.type = FB_RECT;
+    r->head.x = x;
+    r->head.y = y;
+    r->head.clip = clip;
+
+    fb_item_reset_state(&r->head);
+
+    r->w = w;
+    r->h = h;
+    r->color = color;
+
+    fb_queue_edit(EDIT_ADD_RECT, r);
+    return r;
+}
+
+void fb_rm_text(fb_text *t)
+{
+    if(t)
+        fb_queue_edit(EDIT_RM_TEXT, t);
+}
+
+void fb_rm_rect(fb_rect *r)
+{
+    if(r)
+        fb_queue_edit(EDIT_RM_RECT, r);
+}
+
+// The image is loaded from path, or taken from the cache if it was loaded
+// before and the file has not changed. Returns NULL if it can't be loaded.
+fb_image *fb_add_image(int x, int y, const char *path)
+{
+    return fb_add_image_clipped(NULL, x, y, -1, -1, path);
+}
+
+fb_image *fb_add_image_clipped(fb_bbox *clip, int x, int y, int max_w, int max_h, const char *path)
+{
+    if(!fb_fmt)
+    {
+        ERROR("fb: can't load %s before fb_open()\n", path);
+        return NULL;
+    }
+
+    fb_img *img = fb_img_get(path, fb_fmt->id);
+    if(!img)
+        return NULL;
+
+    fb_image *im = pool_alloc(&image_pool);
+    im->head.id = fb_generate_item_id();
+    im->head.type = FB_IMG;
+    im->head.x = x;
+    im->head.y = y;
+    im->head.clip = clip;
+
+    fb_item_reset_state(&im->head);
+
+    im->w = (max_w >= 0) ? imin(img->w, max_w) : img->w;
+    im->h = (max_h >= 0) ? imin(img->h, max_h) : img->h;
+    im->img = img;
+
+    fb_queue_edit(EDIT_ADD_IMAGE, im);
+    return im;
+}
+
+void fb_rm_image(fb_image *im)
+{
+    if(im)
+        fb_queue_edit(EDIT_RM_IMAGE, im);
+}
+
+#define BOX_BORDER 2
+#define SHADOW 10
+fb_msgbox *fb_create_msgbox(int w, int h, int bgcolor)
+{
+    if(scene_msgbox)
+        return scene_msgbox;
+
+    fb_msgbox *box = malloc(sizeof(fb_msgbox));
+    memset(box, 0, sizeof(fb_msgbox));
+
+    int x = fb_width/2 - w/2;
+    int y = fb_height/2 - h/2;
+
+    box->head.id = fb_generate_item_id();
+    box->head.type = FB_BOX;
+    box->head.x = x;
+    box->head.y = y;
+    box->w = w;
+    box->h = h;
+
+    box->background[0] = fb_add_rect(x+SHADOW, y+SHADOW, w, h, GRAY); // shadow
+    box->background[1] = fb_add_rect(x, y, w, h, WHITE); // border
+    box->background[2] = fb_add_rect(x+BOX_BORDER, y+BOX_BORDER,
+                                     w-BOX_BORDER*2, h-BOX_BORDER*2, bgcolor);
+
+    scene_msgbox = box;
+    fb_queue_edit(EDIT_SHOW_MSGBOX, box);
+    return box;
+}
+
+fb_text *fb_msgbox_add_text(int x, int y, int size, char *fmt, ...)
+{
+    char txt[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(txt, sizeof(txt), fmt, ap);
+    va_end(ap);
+
+    fb_msgbox *box = scene_msgbox;
+
+    if(x == -1)
+        x = center_x(0, box->w, size, txt);
+
+    if(y == -1)
+        y = center_y(0, box->h, size);
+
+    x += box->head.x;
+    y += box->head.y;
+
+    fb_text *t = fb_create_text_item(x, y, WHITE, size, txt);
+
+    fb_edit *e = pool_alloc(&edit_pool);
+    e->type = EDIT_ADD_MSGBOX_TEXT;
+    e->item = t;
+    e->target = box;
+    fb_push_edit(e);
+
+    return t;
+}
+
+void fb_msgbox_rm_text(fb_text *text)
+{
+    if(text)
+        fb_queue_edit(EDIT_RM_MSGBOX_TEXT, text);
+}
+
+void fb_destroy_msgbox(void)
+{
+    // only one of the threads racing to close the box gets it
+    fb_msgbox *box = __sync_lock_test_and_set(&scene_msgbox, NULL);
+    if(!box)
+        return;
+
+    // box is freed by the renderer, background must be queued first
+    uint32_t i;
+    for(i = 0; i < ARRAY_SIZE(box->background); ++i)
+        fb_rm_rect(box->background[i]);
+
+    fb_queue_edit(EDIT_DESTROY_MSGBOX, box);
+}
+
+void fb_clear(void)
+{
+    // msgbox background rects must go before the clear destroys them
+    fb_destroy_msgbox();
+    fb_queue_edit(EDIT_CLEAR, NULL);
+}
+
+// must be called with fb_mutex locked
+static void fb_collect_damage(void)
+{
+    uint32_t i;
+    int changed = 0;
+
+    for(i = 0; fb_items.rects && fb_items.rects[i]; ++i)
+        changed |= fb_item_damage(&fb_items.rects[i]->head);
+
+    for(i = 0; fb_items.images && fb_items.images[i]; ++i)
+        changed |= fb_item_damage(&fb_items.images[i]->head);
+
+    for(i = 0; fb_items.texts && fb_items.texts[i]; ++i)
+        changed |= fb_item_damage(&fb_items.texts[i]->head);
+
+    if(changed)
+        dim_valid = 0;
+
+    if(fb_items.msgbox)
+    {
+        fb_msgbox *box = fb_items.msgbox;
+        for(i = 0; box->texts && box->texts[i]; ++i)
+            fb_item_damage(&box->texts[i]->head);
+    }
+}
+
+FB_SPECIALIZE void raster_fill_bpp(fb_raster *r, fb_bbox *b, uint32_t px, const int bpp)
+{
+    uint8_t *bits = r->bits + fb_stride*b->y + b->x*bpp;
+
+    int i;
+    for(i = 0; i < b->h; ++i)
+    {
+        fill_px(bits, px, b->w, bpp);
+        bits += fb_stride;
+    }
+    r->px_drawn += b->w*b->h;
+}
+
+// px is native pixel value
+static void raster_fill(fb_raster *r, fb_bbox *area, uint32_t px)
+{
+    fb_bbox b;
+    if(!bbox_intersect(area, &r->clip, &b))
+        return;
+
+    if(fb_fmt->bpp == 4)
+        raster_fill_bpp(r, &b, px, 4);
+    else
+        raster_fill_bpp(r, &b, px, 2);
+}
+
+FB_SPECIALIZE void raster_char_bpp(fb_raster *r, int x, int y, const uint8_t *glyph, uint32_t px, int size, const int bpp)
+{
+    const int clip_x2 = r->clip.x + r->clip.w;
+    const int clip_y2 = r->clip.y + r->clip.h;
+    // runs are in scaled pixels when the size has its table, font pixels otherwise
+    const int unit = size <= FONT_SCALE_MAX ? 1 : size;
+    const uint32_t *masks = iso_font_scaled[size <= FONT_SCALE_MAX ? size - 1 : 0];
+    int line, row, row_end, x1, x2;
+    uint64_t m, run, end; // 64 bits, so that the end of a full row fits in
+    uint8_t *bits;
+
+    for(line = 0; line < ISO_CHAR_HEIGHT; ++line, y += size)
+    {
+        m = masks[glyph[line]];
+        if(m == 0 || y + size <= r->clip.y || y >= clip_y2)
+            continue;
+
+        row_end = imin(y + size, clip_y2);
+        for(row = imax(y, r->clip.y); row < row_end; ++row)
+        {
+            bits = r->bits + row*fb_stride;
+            // adding the lowest set bit carries over its run and ends up right past it
+            for(run = m; run != 0; run &= end)
+            {
+                end = run + (run & -run);
+                x1 = imax(x + __builtin_ctzll(run)*unit, r->clip.x);
+                x2 = imin(x + __builtin_ctzll(end)*unit, clip_x2);
+                if(x1 >= x2)
+                    continue;
+
+                fill_px(bits + x1*bpp, px, x2 - x1, bpp);
+                r->px_drawn += x2 - x1;
+            }
+        }
+    }
+}
+
+// px is native pixel value
+static void raster_char(fb_raster *r, int x, int y, char c, uint32_t px, int size)
+{
+    if((uint8_t)c >= GLYPH_COUNT || size <= 0)
+        return;
+
+    const uint8_t *glyph = &iso_font[ISO_CHAR_HEIGHT*(uint8_t)c];
+    if(fb_fmt->bpp == 4)
+        raster_char_bpp(r, x, y, glyph, px, size, 4);
+    else
+        raster_char_bpp(r, x, y, glyph, px, size, 2);
+}
+
+static void raster_text(fb_raster *r, fb_text *t)
+{
+    int c_width = ISO_CHAR_WIDTH * t->size;
+    int c_height = ISO_CHAR_HEIGHT * t->size; 
+    fb_bbox clip = r->clip;
+
+    // glyphs are clipped to r->clip, narrow it for the time being
+    if(t->head.clip && !bbox_intersect(&clip, t->head.clip, &r->clip))
+    {
+        r->clip = clip;
+        return;
+    }
+
+    int x = t->head.x;
+    int y = t->head.y;
+    uint32_t px = fb_px(t->color);
+
+    int i;
+    for(i = 0; t->text[i] != 0; ++i)
     {
         switch(t->text[i])
         {
@@ -177,347 +1537,630 @@ void fb_draw_text(fb_text *t)
                 y = t->head.y;
                 continue;
         }
-        if(x < fb_width)
-            fb_draw_char(x, y, t->text[i], t->color, t->size);
+        if(x < fb_width && x + c_width > r->clip.x && x < r->clip.x + r->clip.w &&
+           y + c_height > r->clip.y && y < r->clip.y + r->clip.h)
+        {
+            raster_char(r, x, y, t->text[i], px, t->size);
+        }
         x += c_width;
     }
+
+    r->clip = clip;
 }
 
-void fb_draw_char(int x, int y, char c, uint32_t color, int size)
+static void raster_rect(fb_raster *r, fb_rect *rect)
 {
-    int line = 0;
-    uint8_t bit = 0;
-    int f;
+    fb_bbox b = { rect->head.x, rect->head.y, rect->w, rect->h };
+    if(rect->head.clip && !bbox_intersect(&b, rect->head.clip, &b))
+        return;
+    raster_fill(r, &b, fb_px(rect->color));
+}
 
-    for(; line < ISO_CHAR_HEIGHT; ++line)
-    {
-        f = iso_font[ISO_CHAR_HEIGHT*c+line];
-        for(bit = 0; bit < ISO_CHAR_WIDTH; ++bit)
-        {
-            if(f & (1 << bit))
-                fb_draw_square(x+(bit*size), y, color, size);
-        }
-        y += size;
-    }
+// alpha is 1-254, the top byte of dst is kept
+static inline uint32_t blend_px32(uint32_t dst, uint32_t src, uint32_t alpha)
+{
+    uint32_t rb = (((src & 0xFF00FF)*alpha + (dst & 0xFF00FF)*(255 - alpha)) >> 8) & 0xFF00FF;
+    uint32_t g = (((src & 0xFF00)*alpha + (dst & 0xFF00)*(255 - alpha)) >> 8) & 0xFF00;
+    return (dst & 0xFF000000) | rb | g;
 }
 
-void fb_draw_square(int x, int y, uint32_t color, int size)
+static inline uint16_t blend_px565(uint16_t dst, uint16_t src, uint32_t alpha)
 {
-    uint32_t *bits = fb->bits + (fb_width*y) + x;
-    int i;
-    for(i = 0; i < size; ++i)
+    // green is moved to the top half, so that all channels fit into 32 bits
+    uint32_t s = (src | (src << 16)) & 0x07E0F81F;
+    uint32_t d = (dst | (dst << 16)) & 0x07E0F81F;
+    uint32_t res = ((((s - d)*(alpha >> 3)) >> 5) + d) & 0x07E0F81F;
+    return res | (res >> 16);
+}
+
+FB_SPECIALIZE void raster_image_bpp(fb_raster *r, fb_image *im, fb_bbox *b, const int bpp)
+{
+    fb_img *img = im->img;
+    int sx = b->x - im->head.x;
+    int sy = b->y - im->head.y;
+    uint8_t *dst = r->bits + b->y*fb_stride + b->x*bpp;
+    uint8_t *src = img->px + sy*img->stride + sx*bpp;
+    uint8_t *alpha = img->alpha ? img->alpha + sy*img->w + sx : NULL;
+    uint32_t a, px;
+    int x, y;
+
+    for(y = 0; y < b->h; ++y)
     {
-        android_memset32(bits, color, size*4);
-        bits += fb_width;
+        if(!img->has_alpha)
+            memcpy(dst, src, b->w*bpp);
+        else if(bpp == 4)
+        {
+            for(x = 0; x < b->w; ++x)
+            {
+                px = ((uint32_t*)src)[x];
+                a = px >> 24;
+                if(a == 0xFF)
+                    ((uint32_t*)dst)[x] = px;
+                else if(a != 0)
+                    ((uint32_t*)dst)[x] = blend_px32(((uint32_t*)dst)[x], px, a);
+            }
+        }
+        else
+        {
+            for(x = 0; x < b->w; ++x)
+            {
+                a = alpha[x];
+                if(a == 0xFF)
+                    ((uint16_t*)dst)[x] = ((uint16_t*)src)[x];
+                else if(a != 0)
+                    ((uint16_t*)dst)[x] = blend_px565(((uint16_t*)dst)[x], ((uint16_t*)src)[x], a);
+            }
+            alpha += img->w;
+        }
+        dst += fb_stride;
+        src += img->stride;
     }
+    r->px_drawn += b->w*b->h;
 }
 
-void fb_remove_item(void *item)
+static void raster_image(fb_raster *r, fb_image *im)
 {
-    switch(((fb_item_header*)item)->type)
-    {
-        case FB_TEXT:
-            fb_rm_text((fb_text*)item);
-            break;
-        case FB_RECT:
-            fb_rm_rect((fb_rect*)item);
-            break;
-        case FB_BOX:
-            // fb_destroy_msgbox must be used
-            assert(0);
-            break;
-    }
+    fb_bbox b = { im->head.x, im->head.y, imin(im->w, im->img->w), imin(im->h, im->img->h) };
+    if(im->head.clip && !bbox_intersect(&b, im->head.clip, &b))
+        return;
+    if(!bbox_intersect(&b, &r->clip, &b))
+        return;
+
+    if(fb_fmt->bpp == 4)
+        raster_image_bpp(r, im, &b, 4);
+    else
+        raster_image_bpp(r, im, &b, 2);
 }
 
-void fb_destroy_item(void *item)
+static void raster_overlay(fb_raster *r)
 {
-    switch(((fb_item_header*)item)->type)
+    int y;
+    uint8_t *bits = r->bits + r->clip.y*fb_stride + r->clip.x*fb_fmt->bpp;
+    for(y = 0; y < r->clip.h; ++y)
     {
-        case FB_TEXT:
-            free(((fb_text*)item)->text);
-            break;
-        case FB_RECT:
-            break;
-        case FB_BOX:
-            // fb_destroy_msgbox must be used
-            assert(0);
-            break;
+        (*fb_fmt->blend)(bits, r->clip.w);
+        bits += fb_stride;
     }
-    free(item);
+    r->px_drawn += r->clip.w*r->clip.h;
 }
 
-void fb_draw_rect(fb_rect *r)
+// copies clipped area of src, which has the same layout as fb->bits
+static void raster_copy(fb_raster *r, uint8_t *src)
 {
-    uint32_t *bits = fb->bits + (fb_width*r->head.y) + r->head.x;
+    int y;
+    int offset = r->clip.y*fb_stride + r->clip.x*fb_fmt->bpp;
+    uint8_t *dst = r->bits + offset;
 
-    int i;
-    for(i = 0; i < r->h; ++i)
+    src += offset;
+    for(y = 0; y < r->clip.h; ++y)
     {
-        android_memset32(bits, r->color, r->w*4);
-        bits += fb_width;
+        memcpy(dst, src, r->clip.w*fb_fmt->bpp);
+        src += fb_stride;
+        dst += fb_stride;
     }
+    r->px_drawn += r->clip.w*r->clip.h;
 }
 
-int fb_generate_item_id()
+static void raster_msgbox_contents(fb_raster *r)
 {
-    pthread_mutex_lock(&fb_mutex);
-    static int id = 0;
-    int res = id++;
-    pthread_mutex_unlock(&fb_mutex);
+    uint32_t i;
+    fb_msgbox *box = fb_items.msgbox;
 
-    return res;
+    for(i = 0; i < ARRAY_SIZE(box->background); ++i)
+        raster_rect(r, box->background[i]);
+
+    for(i = 0; box->texts && box->texts[i]; ++i)
+        raster_text(r, box->texts[i]);
 }
 
-static fb_text *fb_create_text_item(int x, int y, uint32_t color, int size, const char *txt)
+// draws whole scene without the msgbox, clipped to r->clip
+static void raster_background(fb_raster *r)
 {
-    fb_text *t = malloc(sizeof(fb_text));
-    t->head.id = fb_generate_item_id();
-    t->head.type = FB_TEXT;
-    t->head.x = x;
-    t->head.y = y;
+    uint32_t i;
+    FB_TIMING_BEGIN(t);
 
-    t->color = color;
-    t->size = size;
+    raster_fill(r, &r->clip, fb_px(BLACK));
+    FB_TIMING_LAP(r->stage_us, FB_STAGE_CLEAR, t);
+
+    // rectangles
+    for(i = 0; fb_items.rects && fb_items.rects[i]; ++i)
+        raster_rect(r, fb_items.rects[i]);
+    FB_TIMING_LAP(r->stage_us, FB_STAGE_RECTS, t);
 
-    t->text = malloc(strlen(txt)+1);
-    strcpy(t->text, txt);
+    // images
+    for(i = 0; fb_items.images && fb_items.images[i]; ++i)
+        raster_image(r, fb_items.images[i]);
+    FB_TIMING_LAP(r->stage_us, FB_STAGE_IMAGES, t);
 
-    return t;
+    // texts
+    for(i = 0; fb_items.texts && fb_items.texts[i]; ++i)
+        raster_text(r, fb_items.texts[i]);
+    FB_TIMING_LAP(r->stage_us, FB_STAGE_TEXTS, t);
 }
 
-fb_text *fb_add_text(int x, int y, uint32_t color, int size, const char *fmt, ...)
+// adds statistics of src to dst
+static void raster_add(fb_raster *dst, fb_raster *src)
 {
-    char txt[512];
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(txt, sizeof(txt), fmt, ap);
-    va_end(ap);
+    dst->px_drawn += src->px_drawn;
+#ifdef MR_FB_TIMING
+    int i;
+    for(i = 0; i < FB_STAGE_COUNT; ++i)
+        dst->stage_us[i] += src->stage_us[i];
+#endif
+}
 
-    return fb_add_text_long(x, y, color, size, txt);
+// draws whole scene, clipped to r->clip
+static void raster_scene(fb_raster *r)
+{
+    if(!fb_items.msgbox || !dim_valid)
+        raster_background(r);
+
+    // msg box
+    if(fb_items.msgbox)
+    {
+        FB_TIMING_BEGIN(t);
+        if(dim_valid)
+            raster_copy(r, dim_bits);
+        else
+            raster_overlay(r);
+        raster_msgbox_contents(r);
+        FB_TIMING_LAP(r->stage_us, FB_STAGE_OVERLAY, t);
+    }
 }
 
-fb_text *fb_add_text_long(int x, int y, uint32_t color, int size, char *text)
+// must be called with fb_mutex locked
+static void fb_render_dim_cache(fb_raster *total)
 {
-    fb_text *t = fb_create_text_item(x, y, color, size, text);
+    fb_raster r = { .clip = { 0, 0, fb_width, fb_height } };
+    FB_TIMING_BEGIN(t);
 
-    pthread_mutex_lock(&fb_mutex);
-    list_add(t, &fb_items.texts);
-    pthread_mutex_unlock(&fb_mutex);
+    if(!dim_bits)
+        dim_bits = malloc(fb_height*fb_stride);
 
-    return t;
+    r.bits = dim_bits;
+    raster_background(&r);
+    raster_overlay(&r);
+    FB_TIMING_LAP(r.stage_us, FB_STAGE_OVERLAY, t);
+
+    raster_add(total, &r);
+    dim_valid = 1;
 }
 
-fb_rect *fb_add_rect(int x, int y, int w, int h, uint32_t color)
+void fb_draw_text(fb_text *t)
 {
-    fb_rect *r = malloc(sizeof(fb_rect));
-    r->head.id = fb_generate_item_id();
-    r->head.type = FB_RECT;
-    r->head.x = x;
-    r->head.y = y;
+    raster_text(&screen_raster, t);
+}
 
-    r->w = w;
-    r->h = h;
-    r->color = color;
+void fb_draw_char(int x, int y, char c, uint32_t color, int size)
+{
+    raster_char(&screen_raster, x, y, c, fb_px(color), size);
+}
 
-    pthread_mutex_lock(&fb_mutex);
-    list_add(r, &fb_items.rects);
-    pthread_mutex_unlock(&fb_mutex);
+void fb_draw_square(int x, int y, uint32_t color, int size)
+{
+    fb_bbox b = { x, y, size, size };
+    raster_fill(&screen_raster, &b, fb_px(color));
+}
 
-    return r;
+void fb_draw_rect(fb_rect *r)
+{
+    raster_rect(&screen_raster, r);
 }
 
-void fb_rm_text(fb_text *t)
+void fb_draw_overlay(void)
 {
-    if(!t)
-        return;
+    raster_overlay(&screen_raster);
+}
 
+void fb_set_render_threads(int count)
+{
     pthread_mutex_lock(&fb_mutex);
-    list_rm(t, &fb_items.texts, &fb_destroy_item);
+    render_threads = count;
+    if(fb_width != 0)
+        render_threads = workers_start(count);
     pthread_mutex_unlock(&fb_mutex);
 }
 
-void fb_rm_rect(fb_rect *r)
+static void tile_frame_grow(void *ptr, int *alloc, int need, int item_size)
 {
-    if(!r)
+    void **p = (void**)ptr;
+    if(need <= *alloc)
         return;
 
-    pthread_mutex_lock(&fb_mutex);
-    list_rm(r, &fb_items.rects, &fb_destroy_item);
-    pthread_mutex_unlock(&fb_mutex);
+    *alloc = need + need/2;
+    *p = realloc(*p, (*alloc)*item_size);
 }
 
-#define BOX_BORDER 2
-#define SHADOW 10
-fb_msgbox *fb_create_msgbox(int w, int h, int bgcolor)
+// adds item to all tiles it overlaps, or only counts it if !place
+static void fb_bin_item(fb_damage *region, fb_item_header *item, int place)
 {
-    if(fb_items.msgbox)
-        return fb_items.msgbox;
+    fb_tile_frame *f = &tile_frame;
+    fb_tile_grid *g;
+    fb_tile *t;
+    fb_bbox b;
+    int i, col, row, col_end, row_end;
 
-    fb_msgbox *box = malloc(sizeof(fb_msgbox));
-    memset(box, 0, sizeof(fb_msgbox));
+    for(i = 0; i < region->count; ++i)
+    {
+        if(!bbox_intersect(&item->drawn, &region->rects[i], &b))
+            continue;
 
-    int x = fb_width/2 - w/2;
-    int y = fb_height/2 - h/2;
+        g = &f->grids[i];
+        col_end = (b.x + b.w - 1)/TILE_SIZE - g->col0;
+        row_end = (b.y + b.h - 1)/TILE_SIZE - g->row0;
 
-    box->head.id = fb_generate_item_id();
-    box->head.type = FB_BOX;
-    box->head.x = x;
-    box->head.y = y;
-    box->w = w;
-    box->h = h;
+        for(row = b.y/TILE_SIZE - g->row0; row <= row_end; ++row)
+        {
+            for(col = b.x/TILE_SIZE - g->col0; col <= col_end; ++col)
+            {
+                t = &f->tiles[g->base + row*g->cols + col];
+                if(item->type == FB_RECT)
+                {
+                    if(place)
+                        f->items[t->first_rect + t->rect_cnt] = item;
+                    ++t->rect_cnt;
+                }
+                else if(item->type == FB_IMG)
+                {
+                    if(place)
+                        f->items[t->first_image + t->image_cnt] = item;
+                    ++t->image_cnt;
+                }
+                else
+                {
+                    if(place)
+                        f->items[t->first_text + t->text_cnt] = item;
+                    ++t->text_cnt;
+                }
+            }
+        }
+    }
+}
 
-    box->background[0] = fb_add_rect(x+SHADOW, y+SHADOW, w, h, GRAY); // shadow
-    box->background[1] = fb_add_rect(x, y, w, h, WHITE); // border
-    box->background[2] = fb_add_rect(x+BOX_BORDER, y+BOX_BORDER,
-                                     w-BOX_BORDER*2, h-BOX_BORDER*2, bgcolor);
+// splits region into tiles and bins the items into them
+static void fb_bin_tiles(fb_damage *region)
+{
+    fb_tile_frame *f = &tile_frame;
+    fb_tile_grid *g;
+    fb_tile *t;
+    fb_bbox cell, *d;
+    int i, x, y, total, place;
+
+    f->tile_cnt = 0;
+    for(i = 0; i < region->count; ++i)
+    {
+        d = &region->rects[i];
+        g = &f->grids[i];
+        g->base = f->tile_cnt;
+        g->col0 = d->x/TILE_SIZE;
+        g->row0 = d->y/TILE_SIZE;
+        g->cols = (d->x + d->w - 1)/TILE_SIZE - g->col0 + 1;
+
+        for(y = g->row0; y <= (d->y + d->h - 1)/TILE_SIZE; ++y)
+        {
+            for(x = g->col0; x < g->col0 + g->cols; ++x)
+            {
+                tile_frame_grow(&f->tiles, &f->tile_alloc, f->tile_cnt+1, sizeof(fb_tile));
+                t = &f->tiles[f->tile_cnt++];
+                memset(t, 0, sizeof(fb_tile));
+
+                cell.x = x*TILE_SIZE;
+                cell.y = y*TILE_SIZE;
+                cell.w = cell.h = TILE_SIZE;
+                bbox_intersect(&cell, d, &t->area);
+            }
+        }
+    }
 
-    pthread_mutex_lock(&fb_mutex);
-    fb_items.msgbox = box;
-    pthread_mutex_unlock(&fb_mutex);
-    return box;
+    // first pass counts the items, second one places them in list
+    // order, so that drawing order is kept
+    for(place = 0; place <= 1; ++place)
+    {
+        for(i = 0; fb_items.rects && fb_items.rects[i]; ++i)
+            fb_bin_item(region, &fb_items.rects[i]->head, place);
+        for(i = 0; fb_items.images && fb_items.images[i]; ++i)
+            fb_bin_item(region, &fb_items.images[i]->head, place);
+        for(i = 0; fb_items.texts && fb_items.texts[i]; ++i)
+            fb_bin_item(region, &fb_items.texts[i]->head, place);
+
+        if(place)
+            break;
+
+        total = 0;
+        for(i = 0; i < f->tile_cnt; ++i)
+        {
+            t = &f->tiles[i];
+            t->first_rect = total;
+            t->first_image = total + t->rect_cnt;
+            t->first_text = t->first_image + t->image_cnt;
+            total += t->rect_cnt + t->image_cnt + t->text_cnt;
+            t->rect_cnt = t->image_cnt = t->text_cnt = 0;
+        }
+        tile_frame_grow(&f->items, &f->item_alloc, total, sizeof(void*));
+    }
 }
 
-fb_text *fb_msgbox_add_text(int x, int y, int size, char *fmt, ...)
+static void fb_draw_tile(int idx, int worker, void *data)
 {
-    char txt[512];
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(txt, sizeof(txt), fmt, ap);
-    va_end(ap);
-
-    fb_msgbox *box = fb_items.msgbox;
+    fb_tile_frame *f = (fb_tile_frame*)data;
+    fb_tile *t = &f->tiles[idx];
+    fb_raster r = { .bits = fb->bits, .clip = t->area };
+    int i;
+    FB_TIMING_BEGIN(time);
 
-    if(x == -1)
-        x = center_x(0, box->w, size, txt);
+    raster_fill(&r, &r.clip, fb_px(BLACK));
+    FB_TIMING_LAP(r.stage_us, FB_STAGE_CLEAR, time);
 
-    if(y == -1)
-        y = center_y(0, box->h, size);
+    for(i = 0; i < t->rect_cnt; ++i)
+        raster_rect(&r, (fb_rect*)f->items[t->first_rect + i]);
+    FB_TIMING_LAP(r.stage_us, FB_STAGE_RECTS, time);
 
-    x += box->head.x;
-    y += box->head.y;
+    for(i = 0; i < t->image_cnt; ++i)
+        raster_image(&r, (fb_image*)f->items[t->first_image + i]);
+    FB_TIMING_LAP(r.stage_us, FB_STAGE_IMAGES, time);
 
-    fb_text *t = fb_create_text_item(x, y, WHITE, size, txt);
-    pthread_mutex_lock(&fb_mutex);
-    list_add(t, &box->texts);
-    pthread_mutex_unlock(&fb_mutex);
+    for(i = 0; i < t->text_cnt; ++i)
+        raster_text(&r, (fb_text*)f->items[t->first_text + i]);
+    FB_TIMING_LAP(r.stage_us, FB_STAGE_TEXTS, time);
 
-    return t;
+    raster_add(&f->totals[worker], &r);
 }
 
-void fb_msgbox_rm_text(fb_text *text)
+// must be called with fb_mutex locked
+static void fb_draw_region(fb_damage *region)
 {
-    if(!text)
-        return;
+    fb_raster total;
+    int i;
 
-    pthread_mutex_lock(&fb_mutex);
-    if(fb_items.msgbox)
-        list_rm(text, &fb_items.msgbox->texts, &fb_destroy_item);
-    pthread_mutex_unlock(&fb_mutex);
+    memset(&total, 0, sizeof(total));
+
+    if(fb_items.msgbox && !dim_valid)
+        fb_render_dim_cache(&total);
+
+    // with the msgbox, the background is a copy from dim_bits and only
+    // the box itself is drawn, that is not worth splitting into tiles
+    if(workers_count() <= 1 || fb_items.msgbox)
+    {
+        for(i = 0; i < region->count; ++i)
+        {
+            fb_raster r = { .bits = fb->bits, .clip = region->rects[i] };
+            raster_scene(&r);
+            raster_add(&total, &r);
+        }
+    }
+    else
+    {
+        fb_bin_tiles(region);
+
+        memset(tile_frame.totals, 0, sizeof(tile_frame.totals));
+        workers_run(tile_frame.tile_cnt, &fb_draw_tile, &tile_frame);
+
+        // stage times are summed over all workers
+        for(i = 0; i < WORKERS_MAX; ++i)
+            raster_add(&total, &tile_frame.totals[i]);
+    }
+
+    stats.px_drawn = total.px_drawn;
+#ifdef MR_FB_TIMING
+    memcpy(frame_timing.us, total.stage_us, sizeof(total.stage_us));
+#endif
 }
 
-void fb_destroy_msgbox(void)
+static void fb_render_frame(void)
 {
     pthread_mutex_lock(&fb_mutex);
-    if(!fb_items.msgbox)
+
+    fb_apply_edits();
+    fb_scroll_pixels();
+
+#ifdef MR_FB_TIMING
+    frame_start = gettime_us();
+#endif
+
+    fb_collect_damage();
+
+    // nothing has changed since last frame
+    if(redraw_damage.count == 0)
     {
         pthread_mutex_unlock(&fb_mutex);
         return;
     }
 
-    fb_msgbox *box = fb_items.msgbox;
-    fb_items.msgbox = NULL;
-    pthread_mutex_unlock(&fb_mutex);
+    // back page is missing also changes from the frame before
+    fb_damage region = redraw_damage;
+    if(fb_direct)
+        damage_add_all(&region, &page_damage[fb_back_page()]);
 
-    list_clear(&box->texts, &fb_destroy_item);
+    fb_draw_region(&region);
 
-    uint32_t i;
-    for(i = 0; i < ARRAY_SIZE(box->background); ++i)
-        fb_rm_rect(box->background[i]);
+    ++stats.frames;
+    stats.px_drawn_total += stats.px_drawn;
 
-    free(box);
-}
+    uint32_t allocs = fb_alloc_count();
+    stats.allocs = allocs - last_alloc_count;
+    stats.allocs_total += stats.allocs;
+    last_alloc_count = allocs;
 
-void fb_clear(void)
-{
-    pthread_mutex_lock(&fb_mutex);
-    list_clear(&fb_items.texts, &fb_destroy_item);
-    list_clear(&fb_items.rects, &fb_destroy_item);
-    pthread_mutex_unlock(&fb_mutex);
+    damage_add_all(&copy_damage, &redraw_damage);
+    redraw_damage.count = 0;
 
-    fb_destroy_msgbox();
-}
+    fb_present();
 
-#define ALPHA 220
-#define BLEND_CLR 0x1B
+    pthread_mutex_unlock(&fb_mutex);
+}
 
-static inline int blend(int value1, int value2) {
-    int r = (0xFF-ALPHA)*value1 + ALPHA*value2;
-    return (r+1 + (r >> 8)) >> 8; // divide by 255
+// waits on request_cond for up to us, render.lock must be locked. Cond
+// waits use the realtime clock, gettime_us() is monotonic.
+static void fb_render_wait(uint64_t us)
+{
+    struct timeval tv;
+    struct timespec ts;
+    uint64_t abs;
+
+    gettimeofday(&tv, NULL);
+    abs = (uint64_t)tv.tv_sec*1000000 + tv.tv_usec + us;
+    ts.tv_sec = abs/1000000;
+    ts.tv_nsec = (abs%1000000)*1000;
+    pthread_cond_timedwait(&render.request_cond, &render.lock, &ts);
 }
 
-void fb_draw_overlay(void)
+static void *fb_render_thread_work(void *data)
 {
-    union clr_t
-    {
-        int i;
-        uint8_t c[4];
-    };
+    uint64_t now;
 
-    int i;
-    union clr_t *unions = (union clr_t *)fb->bits;
-    const int size = fb_width*fb_height;
-    for(i = 0; i < size; ++i)
+    pthread_mutex_lock(&render.lock);
+    while(1)
     {
-        unions->c[0] = blend(unions->c[0], BLEND_CLR);
-        unions->c[1] = blend(unions->c[1], BLEND_CLR);
-        unions->c[2] = blend(unions->c[2], BLEND_CLR);
-        ++unions;
+        while(!render.pending && !render.quit)
+            pthread_cond_wait(&render.request_cond, &render.lock);
+        wakeup_count();
+
+        if(!render.pending)
+            break;
+
+        // wait for the next refresh, requests made meanwhile go to this
+        // frame. fb_flush() and fb_close() don't wait for it.
+        while(!render.quit && !render.flushing &&
+              (now = gettime_us()) < render.last_frame + render.interval_us)
+        {
+            fb_render_wait(render.last_frame + render.interval_us - now);
+        }
+
+        render.pending = 0;
+        render.rendering = 1;
+        render.last_frame = gettime_us();
+        pthread_mutex_unlock(&render.lock);
+
+        fb_render_frame();
+
+        pthread_mutex_lock(&render.lock);
+        render.rendering = 0;
+        pthread_cond_broadcast(&render.done_cond);
     }
+    pthread_mutex_unlock(&render.lock);
+    return NULL;
 }
 
-void fb_draw(void)
+static uint32_t fb_frame_interval(struct fb_var_screeninfo *vi)
 {
-    if(fb_frozen)
+    uint64_t frame_ps = (uint64_t)vi->pixclock *
+            (vi->xres + vi->left_margin + vi->right_margin + vi->hsync_len) *
+            (vi->yres + vi->upper_margin + vi->lower_margin + vi->vsync_len);
+    uint32_t us = frame_ps/1000000;
+
+    // lots of drivers don't fill in the timings
+    if(us < 1000000/FB_MAX_HZ || us > 1000000/FB_MIN_HZ)
+        us = 1000000/60;
+    return us;
+}
+
+static void fb_start_render_thread(struct fb_var_screeninfo *vi)
+{
+    render.quit = 0;
+    render.pending = 0;
+    render.rendering = 0;
+    render.last_frame = 0;
+    render.interval_us = fb_frame_interval(vi);
+
+    if(pthread_create(&render.thread, NULL, fb_render_thread_work, NULL) != 0)
+    {
+        ERROR("fb: failed to create render thread, drawing synchronously\n");
         return;
+    }
 
-    uint32_t i;
-    pthread_mutex_lock(&fb_mutex);
+    INFO("fb: render thread started, %u us per frame\n", render.interval_us);
+    render.running = 1;
+}
 
-    fb_fill(BLACK);
+static void fb_stop_render_thread(void)
+{
+    if(!render.running)
+        return;
 
-    // rectangles
-    for(i = 0; fb_items.rects && fb_items.rects[i]; ++i)
-        fb_draw_rect(fb_items.rects[i]);
+    // frame which is still pending is rendered before the thread quits
+    pthread_mutex_lock(&render.lock);
+    render.quit = 1;
+    pthread_cond_signal(&render.request_cond);
+    pthread_mutex_unlock(&render.lock);
 
-    // texts
-    for(i = 0; fb_items.texts && fb_items.texts[i]; ++i)
-        fb_draw_text(fb_items.texts[i]);
+    pthread_join(render.thread, NULL);
+    render.running = 0;
+}
 
-    // msg box
-    if(fb_items.msgbox)
+// must be called with render.lock locked
+static void fb_flush_locked(void)
+{
+    ++render.flushing;
+    while(render.running && (render.pending || render.rendering))
     {
-        fb_draw_overlay();
+        pthread_cond_signal(&render.request_cond);
+        pthread_cond_wait(&render.done_cond, &render.lock);
+    }
+    --render.flushing;
+}
 
-        fb_msgbox *box = fb_items.msgbox;
+void fb_draw(void)
+{
+    pthread_mutex_lock(&render.lock);
+    if(fb_frozen)
+    {
+        pthread_mutex_unlock(&render.lock);
+        return;
+    }
 
-        for(i = 0; i < ARRAY_SIZE(box->background); ++i)
-            fb_draw_rect(box->background[i]);
+    ++render.frames_requested;
 
-        for(i = 0; box->texts && box->texts[i]; ++i)
-            fb_draw_text(box->texts[i]);
+    if(render.running)
+    {
+        render.pending = 1;
+        pthread_cond_signal(&render.request_cond);
+        pthread_mutex_unlock(&render.lock);
+        return;
     }
+    pthread_mutex_unlock(&render.lock);
 
-    pthread_mutex_unlock(&fb_mutex);
+    fb_render_frame();
+}
 
-    fb_update();
+void fb_flush(void)
+{
+    pthread_mutex_lock(&render.lock);
+    fb_flush_locked();
+    pthread_mutex_unlock(&render.lock);
 }
 
 void fb_freeze(int freeze)
 {
+    pthread_mutex_lock(&render.lock);
     if(freeze)
+    {
+        // frames requested before the freeze still have to be shown
+        fb_flush_locked();
         ++fb_frozen;
+    }
     else
         --fb_frozen;
+    pthread_mutex_unlock(&render.lock);
 }
 
 int center_x(int x, int width, int size, const char *text)
@@ -535,14 +2178,8 @@ void fb_push_context(void)
     fb_items_t *ctx = malloc(sizeof(fb_items_t));
     memset(ctx, 0, sizeof(fb_items_t));
 
-    pthread_mutex_lock(&fb_mutex);
-
-    list_move(&fb_items.texts, &ctx->texts);
-    list_move(&fb_items.rects, &ctx->rects);
-    ctx->msgbox = fb_items.msgbox;
-    fb_items.msgbox = NULL;
-
-    pthread_mutex_unlock(&fb_mutex);
+    ctx->msgbox = __sync_lock_test_and_set(&scene_msgbox, NULL);
+    fb_queue_edit(EDIT_PUSH_CONTEXT, ctx);
 
     list_add(ctx, &inactive_ctx);
 }
@@ -556,16 +2193,11 @@ void fb_pop_context(void)
 
     int idx = list_item_count(inactive_ctx)-1;
     fb_items_t *ctx = inactive_ctx[idx];
+    list_rm_at(idx, &inactive_ctx, NULL);
 
-    pthread_mutex_lock(&fb_mutex);
-
-    list_move(&ctx->texts, &fb_items.texts);
-    list_move(&ctx->rects, &fb_items.rects);
-    fb_items.msgbox = ctx->msgbox;
-
-    pthread_mutex_unlock(&fb_mutex);
-
-    list_rm(ctx, &inactive_ctx, &free);
+    // ctx is freed once its items are moved back
+    scene_msgbox = ctx->msgbox;
+    fb_queue_edit(EDIT_POP_CONTEXT, ctx);
 
     fb_draw();
 }
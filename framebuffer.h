@@ -4,9 +4,14 @@
 #include <linux/fb.h>
 #include <stdarg.h>
 
+#include "fb_format.h"
+#include "fb_image.h"
+
+// bits and mapped are in the native format of the panel, with fi.line_length
+// bytes per line
 struct FB {
-    uint32_t *bits;
-    uint32_t *mapped;
+    uint8_t *bits;
+    uint8_t *mapped;
     uint32_t size;
     int fd;
     struct fb_fix_screeninfo fi;
@@ -35,10 +40,32 @@ enum
     SIZE_EXTRA     = 4,
 };
 
-#define fb_size(fb) ((fb)->vi.xres * (fb)->vi.yres * 4)
+#define fb_size(fb) ((fb)->vi.yres * (fb)->fi.line_length)
 extern int fb_width;
 extern int fb_height;
 
+typedef struct fb_backend fb_backend;
+struct fb_backend
+{
+    const char *name;
+    int fd;
+    void *data;
+
+    // fills vi and fi and returns pointer to the mapped pages or NULL
+    void *(*open)(fb_backend *b, struct fb_var_screeninfo *vi, struct fb_fix_screeninfo *fi);
+    void (*close)(fb_backend *b, void *mapped, struct fb_fix_screeninfo *fi);
+    // shows page n, vi is the one returned from open()
+    int (*set_page)(fb_backend *b, struct fb_var_screeninfo *vi, unsigned n);
+    void (*destroy)(fb_backend *b);
+};
+
+fb_backend *fb_backend_fbdev(const char *path);
+fb_backend *fb_backend_memory(int w, int h);
+fb_backend *fb_backend_memory_fmt(int w, int h, int format, int line_length);
+fb_backend *fb_backend_file(const char *dir, int w, int h);
+void fb_backend_destroy(fb_backend *b);
+void fb_set_backend(fb_backend *b);
+
 int fb_open(void);
 void fb_close(void);
 void fb_update(void);
@@ -51,23 +78,43 @@ enum
     FB_TEXT = 0,
     FB_RECT = 1,
     FB_BOX  = 2,
+    FB_IMG  = 3,
 };
 
+typedef struct
+{
+    int x, y;
+    int w, h;
+} fb_bbox;
+
 typedef struct
 {
     int id;
     int type;
     int x;
     int y;
+    // if set, the item is drawn only inside it. Can be shared by a group
+    // of items, e.g. all rows of a listview.
+    fb_bbox *clip;
+
+    // bounds (clipped and whole) and hash of the item as it was last
+    // drawn, used to find out what changed since the previous frame
+    fb_bbox drawn;
+    fb_bbox drawn_full;
+    uint32_t drawn_hash;
 } fb_item_header;
 
+#define FB_TEXT_INLINE 32
+
 typedef struct
 {
     fb_item_header head;
 
     uint32_t color;
     int8_t size;
+    // points to inline_text for short strings, change it with fb_text_set()
     char *text;
+    char inline_text[FB_TEXT_INLINE];
 } fb_text;
 
 typedef struct
@@ -79,6 +126,17 @@ typedef struct
     uint32_t color;
 } fb_rect;
 
+// Drawn above rects and under texts. w and h can be made smaller than
+// the image to show only its top-left part.
+typedef struct
+{
+    fb_item_header head;
+
+    int w;
+    int h;
+    fb_img *img;
+} fb_image;
+
 typedef struct
 {
     fb_item_header head;
@@ -92,6 +150,7 @@ typedef struct
 {
     fb_text **texts;
     fb_rect **rects;
+    fb_image **images;
     fb_msgbox *msgbox;
 } fb_items_t;
 
@@ -100,12 +159,20 @@ int fb_generate_item_id();
 fb_text *fb_add_text(int x, int y, uint32_t color, int size, const char *fmt, ...);
 fb_text *fb_add_text_long(int x, int y, uint32_t color, int size, char *text);
 fb_rect *fb_add_rect(int x, int y, int w, int h, uint32_t color);
+fb_image *fb_add_image(int x, int y, const char *path);
+// The item is complete before the renderer sees it, so it is clipped from
+// its first frame. Images are cropped to max_w x max_h, -1 for no limit.
+fb_text *fb_add_text_clipped(fb_bbox *clip, int x, int y, uint32_t color, int size, const char *text);
+fb_rect *fb_add_rect_clipped(fb_bbox *clip, int x, int y, int w, int h, uint32_t color);
+fb_image *fb_add_image_clipped(fb_bbox *clip, int x, int y, int max_w, int max_h, const char *path);
+void fb_text_set(fb_text *t, const char *text);
 fb_msgbox *fb_create_msgbox(int w, int h, int bgcolor);
 fb_text *fb_msgbox_add_text(int x, int y, int size, char *txt, ...);
 void fb_msgbox_rm_text(fb_text *text);
 void fb_destroy_msgbox(void);
 void fb_rm_text(fb_text *t);
 void fb_rm_rect(fb_rect *r);
+void fb_rm_image(fb_image *im);
 
 void fb_draw_text(fb_text *t);
 void fb_draw_char(int x, int y, char c, uint32_t color, int size);
@@ -114,9 +181,35 @@ void fb_draw_overlay(void);
 void fb_draw_rect(fb_rect *r);
 void fb_fill(uint32_t color);
 void fb_draw(void);
+void fb_flush(void);
+void fb_set_render_threads(int count);
 void fb_clear(void);
 void fb_freeze(int freeze);
 int fb_clone(char **buff);
+// FB_FMT_* of the frames returned by fb_clone(), they have fi.line_length bytes per line
+int fb_get_format(void);
+
+void fb_invalidate(void);
+// Moves content of the area by dy pixels in next frame. Items inside it
+// which are moved by the same dy before that frame are not drawn again.
+void fb_scroll(int x, int y, int w, int h, int dy);
+
+typedef struct
+{
+    uint32_t frames;           // rendered frames
+    uint32_t frames_requested; // fb_draw() calls
+    uint32_t px_drawn;  // pixels rasterized in last frame
+    uint32_t px_copied; // pixels copied to the mapped page in last frame
+    uint64_t px_drawn_total;
+    uint64_t px_copied_total;
+    uint32_t allocs;           // heap allocations for items and lists since the previous frame
+    uint64_t allocs_total;
+} fb_stats;
+
+void fb_get_stats(fb_stats *s);
+// gettime_us() at which the render thread can start the next frame, 0 if
+// frames are drawn synchronously
+uint64_t fb_next_frame_time(void);
 
 void fb_push_context(void);
 void fb_pop_context(void);
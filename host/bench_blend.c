@@ -0,0 +1,92 @@
+/*
+ * Mpixels/s of every msgbox blend path this CPU has, over a buffer of the
+ * size of the screen, and of the one blend_init() selects.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "blend.h"
+#include "util.h"
+
+typedef struct
+{
+    const char *name;
+    blend_func func;
+} blend_path;
+
+static void bench(const char *name, blend_func f, uint32_t *px, int count, int runs)
+{
+    uint64_t start, us;
+    int i;
+
+    // one run to fault the pages in and warm up the caches
+    (*f)(px, count);
+
+    start = gettime_us();
+    for(i = 0; i < runs; ++i)
+        (*f)(px, count);
+    us = gettime_us() - start + 1;
+
+    printf("%-8s %8.1f Mpixels/s\n", name, (double)count*runs/us);
+}
+
+int main(int argc, char *argv[])
+{
+    blend_path paths[5];
+    int w = 800, h = 1280, runs = 200;
+    int i, n = 0;
+    uint32_t *px;
+    int c;
+
+    while((c = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch(c)
+        {
+            case 's':
+                if(sscanf(optarg, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+                    goto usage;
+                break;
+            case 'n': runs = atoi(optarg); break;
+            default:
+                goto usage;
+        }
+    }
+
+    paths[n].name = "c";
+    paths[n++].func = blend_overlay_c;
+#if defined(__ARM_NEON__)
+    paths[n].name = "neon";
+    paths[n++].func = blend_overlay_neon;
+#endif
+#if defined(__SSE2__)
+    paths[n].name = "sse2";
+    paths[n++].func = blend_overlay_sse2;
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        paths[n].name = "avx2";
+        paths[n++].func = blend_overlay_avx2;
+    }
+#endif
+    blend_init();
+    paths[n].name = "selected";
+    paths[n++].func = blend_overlay;
+
+    px = malloc(w*h*4);
+    srand(1);
+    for(i = 0; i < w*h; ++i)
+        px[i] = rand();
+
+    printf("%dx%d px, %d runs\n", w, h, runs);
+    for(i = 0; i < n; ++i)
+        bench(paths[i].name, paths[i].func, px, w*h, runs);
+
+    free(px);
+    return 0;
+
+usage:
+    printf("usage: %s [-s WxH] [-n RUNS]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,151 @@
+/*
+ * 1 to N threads allocate and free objects of one pool as fast as they
+ * can, each keeping up to HELD of them at random. Reports Mops/s of the
+ * lock-free pool and of the same calls under one mutex, as the pool was
+ * before. Every object is stamped by its owner, one handed out twice or
+ * not zeroed fails the run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "util.h"
+
+#define HELD 64
+#define MAX_THREADS 16
+
+typedef struct
+{
+    uint32_t owner;
+    uint32_t serial;
+    char payload[56];
+} bench_obj;
+
+static pool obj_pool = POOL_INITIALIZER(bench_obj, 64);
+static pthread_mutex_t obj_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int use_mutex;
+static int ops;
+static volatile int errors;
+
+static bench_obj *obj_alloc(void)
+{
+    bench_obj *o;
+    if(!use_mutex)
+        return pool_alloc(&obj_pool);
+
+    pthread_mutex_lock(&obj_mutex);
+    o = pool_alloc(&obj_pool);
+    pthread_mutex_unlock(&obj_mutex);
+    return o;
+}
+
+static void obj_free(bench_obj *o)
+{
+    if(!use_mutex)
+    {
+        pool_free(&obj_pool, o);
+        return;
+    }
+
+    pthread_mutex_lock(&obj_mutex);
+    pool_free(&obj_pool, o);
+    pthread_mutex_unlock(&obj_mutex);
+}
+
+static void *bench_thread(void *data)
+{
+    uint32_t id = (uint32_t)(uintptr_t)data;
+    uint32_t seed = id*7919 + 1;
+    bench_obj *held[HELD];
+    uint32_t serials[HELD];
+    int i, k, count = 0;
+
+    for(i = 0; i < ops; ++i)
+    {
+        seed = seed*1103515245 + 12345;
+        k = (seed >> 16) % HELD;
+
+        if(count == HELD || (count > 0 && (seed & 0x10000)))
+        {
+            k %= count;
+            if(held[k]->owner != id || held[k]->serial != serials[k] ||
+                held[k]->payload[55] != (char)id)
+            {
+                __sync_fetch_and_add(&errors, 1);
+            }
+            obj_free(held[k]);
+            --count;
+            held[k] = held[count];
+            serials[k] = serials[count];
+        }
+        else
+        {
+            bench_obj *o = obj_alloc();
+            if(!o || o->owner != 0 || o->payload[55] != 0)
+            {
+                __sync_fetch_and_add(&errors, 1);
+                continue;
+            }
+            o->owner = id;
+            o->serial = i;
+            o->payload[55] = id;
+            serials[count] = i;
+            held[count++] = o;
+        }
+    }
+
+    while(count > 0)
+        obj_free(held[--count]);
+    return NULL;
+}
+
+static double bench(int threads)
+{
+    pthread_t th[MAX_THREADS];
+    uint64_t start, us;
+    int i;
+
+    start = gettime_us();
+    for(i = 0; i < threads; ++i)
+        pthread_create(&th[i], NULL, bench_thread, (void*)(uintptr_t)(i + 1));
+    for(i = 0; i < threads; ++i)
+        pthread_join(th[i], NULL);
+    us = gettime_us() - start + 1;
+
+    return (double)ops*threads/us;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = 4, threads;
+    int c;
+
+    ops = 2000000;
+    while((c = getopt(argc, argv, "t:n:")) != -1)
+    {
+        switch(c)
+        {
+            case 't': max_threads = imin(imax(atoi(optarg), 1), MAX_THREADS); break;
+            case 'n': ops = atoi(optarg); break;
+            default:
+                printf("usage: %s [-t MAX_THREADS] [-n OPS_PER_THREAD]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    printf("%d ops per thread, up to %d objects held by each\n", ops, HELD);
+    for(threads = 1; threads <= max_threads; ++threads)
+    {
+        use_mutex = 0;
+        printf("%d thread(s): lock-free %7.2f Mops/s", threads, bench(threads));
+        use_mutex = 1;
+        printf(", mutex %7.2f Mops/s\n", bench(threads));
+    }
+    printf("%u slabs, %d errors\n", obj_pool.heap_allocs, errors);
+
+    pool_destroy(&obj_pool);
+    return errors != 0;
+}
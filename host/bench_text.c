@@ -0,0 +1,170 @@
+/*
+ * Text drawing before and after the glyph span tables. A screen of texts
+ * in all four sizes is drawn by the renderer, its texts stage timed by the
+ * fb timing, and by the old per-pixel loop, which filled one size*size
+ * square for every set bit of the font. Both must give the same pixels.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "fb_timing.h"
+#include "util.h"
+
+#define MAX_TEXTS 256
+#define TEXT_X 10
+
+extern const unsigned char iso_font[];
+
+typedef struct
+{
+    int x, y, size;
+    uint32_t color;
+    char text[32];
+} bench_text;
+
+static bench_text texts[MAX_TEXTS];
+static int text_count;
+
+static void texts_create(void)
+{
+    static const uint32_t colors[] = { WHITE, 0xFF00FFFF, 0xFFCCCCCC, 0xFF3366CC };
+    bench_text *t;
+    int y, size;
+
+    for(y = 0, size = SIZE_SMALL; text_count < MAX_TEXTS; ++text_count)
+    {
+        if(y + ISO_CHAR_HEIGHT*size > fb_height)
+            break;
+
+        t = &texts[text_count];
+        t->x = TEXT_X;
+        t->y = y;
+        t->size = size;
+        t->color = colors[text_count % ARRAY_SIZE(colors)];
+        // 20 chars of the biggest size fit into 800 px
+        snprintf(t->text, sizeof(t->text), "ROM %03d Ubuntu Touch", text_count);
+        fb_add_text(t->x, t->y, t->color, t->size, "%s", t->text);
+
+        y += ISO_CHAR_HEIGHT*size + 2;
+        size = size % SIZE_EXTRA + 1;
+    }
+}
+
+// the loop of the old fb_draw_char()
+static void ref_draw_char(uint8_t *bits, int bpp, int x, int y, char c, uint32_t px, int size)
+{
+    int line, bit, i, k;
+    uint8_t f;
+
+    for(line = 0; line < ISO_CHAR_HEIGHT; ++line, y += size)
+    {
+        f = iso_font[ISO_CHAR_HEIGHT*c + line];
+        for(bit = 0; bit < ISO_CHAR_WIDTH; ++bit)
+        {
+            if(!(f & (1 << bit)))
+                continue;
+
+            for(i = 0; i < size; ++i)
+            {
+                for(k = 0; k < size; ++k)
+                {
+                    if(bpp == 4)
+                        ((uint32_t*)bits)[(y + i)*fb_width + x + bit*size + k] = px;
+                    else
+                        ((uint16_t*)bits)[(y + i)*fb_width + x + bit*size + k] = px;
+                }
+            }
+        }
+    }
+}
+
+static void ref_draw(uint8_t *bits, const fb_format *f)
+{
+    int i, k;
+
+    for(i = 0; i < text_count; ++i)
+    {
+        for(k = 0; texts[i].text[k]; ++k)
+        {
+            ref_draw_char(bits, f->bpp, texts[i].x + k*ISO_CHAR_WIDTH*texts[i].size, texts[i].y,
+                          texts[i].text[k], (*f->color)(texts[i].color), texts[i].size);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    const fb_format *f;
+    fb_timing_summary sum;
+    uint32_t *shown, *ref;
+    uint64_t start, ref_us = 0;
+    uint8_t *bits;
+    int i, glyphs = 0, runs = 200, fails;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "n:")) != -1)
+    {
+        if(c == 'n')
+            runs = imax(atoi(optarg), 1);
+        else if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [options]\n" HOST_FB_USAGE
+                   "  -n RUNS             frames to draw each way (200)\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    f = fb_format_get(fb_get_format());
+    texts_create();
+    for(i = 0; i < text_count; ++i)
+        glyphs += strlen(texts[i].text);
+
+    // after: the texts stage of full redraws
+    fb_draw();
+    for(i = 0; i < runs; ++i)
+    {
+        fb_invalidate();
+        fb_draw();
+        fb_flush();
+    }
+    fb_timing_summarize(FB_STAGE_TEXTS, &sum);
+    shown = host_fb_grab();
+
+    // before: the same texts, one square per font bit
+    bits = malloc(fb_width*fb_height*f->bpp);
+    for(i = 0; i < runs; ++i)
+    {
+        (*f->fill)(bits, (*f->color)(BLACK), fb_width*fb_height);
+        start = gettime_us();
+        ref_draw(bits, f);
+        ref_us += gettime_us() - start;
+    }
+
+    ref = malloc(fb_width*fb_height*4);
+    for(i = 0; i < fb_width*fb_height; ++i)
+        ref[i] = (*f->to_color)(f->bpp == 4 ? ((uint32_t*)bits)[i] : ((uint16_t*)bits)[i]) | 0xFF000000;
+    fails = host_fb_diff("per-pixel loop", ref, shown) != 0;
+
+    printf("%d texts, %d glyphs, %s, %d runs\n", text_count, glyphs, f->name, runs);
+    printf("per-pixel loop  %6llu us per frame\n", (unsigned long long)(ref_us/runs));
+    printf("glyph spans     %6u us per frame (p50 of the texts stage of %u frames, p95 %u us)\n",
+           sum.p50, sum.samples, sum.p95);
+    printf("bench_text: %d failed\n", fails);
+
+    free(bits);
+    free(ref);
+    free(shown);
+    fb_clear();
+    host_fb_close();
+    return fails;
+}
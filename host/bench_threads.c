@@ -0,0 +1,101 @@
+/*
+ * How rendering scales with the render threads. The ROM list with many
+ * rows is scrolled and fully redrawn with 1 to N threads, then the same
+ * again with a msgbox over it. Frames are flushed one by one, so the time
+ * per frame is what the frame costs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "host_ui.h"
+#include "framebuffer.h"
+#include "util.h"
+
+static double ms_per_frame(uint64_t start, int frames)
+{
+    return (double)(gettime_us() - start)/1000/imax(frames, 1);
+}
+
+static void bench(listview *view, int threads, int steps, double *base)
+{
+    uint64_t start;
+    double scroll, redraw;
+    int i;
+
+    fb_set_render_threads(threads);
+    host_list_scroll(view, 10);
+
+    start = gettime_us();
+    host_list_scroll(view, steps);
+    scroll = ms_per_frame(start, steps);
+
+    start = gettime_us();
+    for(i = 0; i < steps; ++i)
+    {
+        fb_invalidate();
+        fb_draw();
+        fb_flush();
+    }
+    redraw = ms_per_frame(start, steps);
+
+    if(threads == 1)
+    {
+        base[0] = scroll;
+        base[1] = redraw;
+    }
+    printf("  %d thread(s): scroll %6.2f ms per frame (%.2fx), full redraw %6.2f ms per frame (%.2fx)\n",
+           threads, scroll, base[0]/scroll, redraw, base[1]/redraw);
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    int rows = 300, steps = 200, max_threads = 4;
+    double base[2];
+    listview *view;
+    int t, c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "n:S:T:")) != -1)
+    {
+        switch(c)
+        {
+            case 'n': rows = atoi(optarg); break;
+            case 'S': steps = imax(atoi(optarg), 1); break;
+            case 'T': max_threads = imax(atoi(optarg), 1); break;
+            default:
+                if(host_fb_parse_opt(&opts, c, optarg) < 0)
+                {
+                    printf("usage: %s [options]\n" HOST_FB_USAGE
+                           "  -n ROWS             rows of the ROM list (300)\n"
+                           "  -S STEPS            frames of each run (200)\n"
+                           "  -T N                up to N render threads (4)\n", argv[0]);
+                    return 1;
+                }
+                break;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    view = host_list_create(rows, NULL);
+
+    printf("ROM list with %d rows, %dx%d\n", rows, fb_width, fb_height);
+    for(t = 1; t <= max_threads; ++t)
+        bench(view, t, steps, base);
+
+    fb_create_msgbox(500, 250, DRED);
+    fb_msgbox_add_text(-1, -1, SIZE_NORMAL, "Booting ROM...");
+    printf("with a msgbox\n");
+    for(t = 1; t <= max_threads; ++t)
+        bench(view, t, steps, base);
+
+    listview_destroy(view);
+    fb_clear();
+    host_fb_close();
+    return 0;
+}
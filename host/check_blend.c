@@ -0,0 +1,111 @@
+/*
+ * Runs every msgbox blend path this CPU has on random buffers of random
+ * lengths and alignments. All of them must give exactly the pixels of
+ * blend_overlay_c(), keep the top byte and not touch anything around
+ * the buffer.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "blend.h"
+
+#define MAX_COUNT 1000
+#define GUARD 8
+#define GUARD_PX 0xA5A5A5A5
+
+typedef struct
+{
+    const char *name;
+    blend_func func;
+} blend_path;
+
+static int paths_get(blend_path *paths)
+{
+    int n = 0;
+
+#if defined(__ARM_NEON__)
+    paths[n].name = "neon";
+    paths[n++].func = blend_overlay_neon;
+#endif
+#if defined(__SSE2__)
+    paths[n].name = "sse2";
+    paths[n++].func = blend_overlay_sse2;
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        paths[n].name = "avx2";
+        paths[n++].func = blend_overlay_avx2;
+    }
+#endif
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint32_t src[MAX_COUNT + 2*GUARD];
+    static uint32_t ref[MAX_COUNT + 2*GUARD];
+    static uint32_t px[MAX_COUNT + 2*GUARD];
+    blend_path paths[4];
+    int i, k, p, n, count, offset, fails = 0;
+    int runs = 2000;
+    int c;
+
+    while((c = getopt(argc, argv, "n:r:")) != -1)
+    {
+        switch(c)
+        {
+            case 'n': runs = atoi(optarg); break;
+            case 'r': srand(atoi(optarg)); break;
+            default:
+                printf("usage: %s [-n RUNS] [-r SEED]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    n = paths_get(paths);
+    for(k = 0; k < runs; ++k)
+    {
+        // short counts and odd offsets go through the scalar tails
+        count = (k % 4 == 0) ? rand()%MAX_COUNT : rand()%40;
+        offset = rand()%GUARD;
+
+        for(i = 0; i < MAX_COUNT + 2*GUARD; ++i)
+            src[i] = GUARD_PX;
+        for(i = 0; i < count; ++i)
+            src[GUARD + offset + i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+
+        memcpy(ref, src, sizeof(src));
+        blend_overlay_c(ref + GUARD + offset, count);
+
+        for(i = 0; i < count; ++i)
+        {
+            if((ref[GUARD + offset + i] >> 24) != (src[GUARD + offset + i] >> 24))
+            {
+                fprintf(stderr, "c: top byte of %08X changed\n", src[GUARD + offset + i]);
+                ++fails;
+                break;
+            }
+        }
+
+        for(p = 0; p < n; ++p)
+        {
+            memcpy(px, src, sizeof(src));
+            (*paths[p].func)(px + GUARD + offset, count);
+            if(memcmp(px, ref, sizeof(px)) == 0)
+                continue;
+
+            for(i = 0; i < MAX_COUNT + 2*GUARD && px[i] == ref[i]; ++i);
+            fprintf(stderr, "%s: %d px at offset %d, px %d of %08X is %08X, expected %08X\n",
+                    paths[p].name, count, offset, i - GUARD - offset, src[i], px[i], ref[i]);
+            ++fails;
+        }
+    }
+
+    printf("check_blend: %d failed, c", fails);
+    for(p = 0; p < n; ++p)
+        printf(", %s", paths[p].name);
+    printf(" on %d buffers\n", runs);
+    return fails != 0;
+}
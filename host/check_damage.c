@@ -0,0 +1,190 @@
+/*
+ * Random edits of rects, texts and the msgbox, every few frames the shown
+ * frame must be the same as a full redraw of the scene. With the file
+ * backend, the last written frame must also be the shown one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "util.h"
+
+#define ITEMS 40
+
+static fb_rect *rects[ITEMS];
+static fb_text *texts[ITEMS];
+static int msgbox = 0;
+
+static void random_edit(void)
+{
+    int k = rand() % ITEMS;
+    switch(rand() % 9)
+    {
+        case 0:
+            if(!rects[k])
+                rects[k] = fb_add_rect(rand()%(fb_width+100) - 50, rand()%(fb_height+100) - 50, rand()%300, rand()%300, rand());
+            break;
+        case 1:
+            if(rects[k])
+            {
+                fb_rm_rect(rects[k]);
+                rects[k] = NULL;
+            }
+            break;
+        case 2:
+            if(rects[k])
+            {
+                rects[k]->head.x += rand()%21 - 10;
+                rects[k]->head.y += rand()%21 - 10;
+            }
+            break;
+        case 3:
+            if(rects[k])
+                rects[k]->color = rand();
+            break;
+        case 4:
+            if(!texts[k])
+                texts[k] = fb_add_text(rand()%fb_width, rand()%(fb_height+20) - 20, rand(), 1 + rand()%4, "Hi %d\nxx", rand()%1000);
+            break;
+        case 5:
+            if(texts[k])
+            {
+                fb_rm_text(texts[k]);
+                texts[k] = NULL;
+            }
+            break;
+        case 6:
+            if(texts[k])
+            {
+                char buff[16];
+                snprintf(buff, sizeof(buff), "%d", rand()%100);
+                fb_text_set(texts[k], buff);
+                texts[k]->head.y += rand()%11 - 5;
+            }
+            break;
+        case 7:
+            if(rand()%8 != 0)
+                break;
+            if(msgbox)
+                fb_destroy_msgbox();
+            else
+            {
+                fb_create_msgbox(500, 300, rand());
+                fb_msgbox_add_text(-1, -1, SIZE_BIG, "box");
+            }
+            msgbox = !msgbox;
+            break;
+        case 8:
+            if(msgbox && rand()%2)
+                fb_msgbox_add_text(rand()%100, rand()%200, SIZE_NORMAL, "%d", rand());
+            break;
+    }
+}
+
+// frame_NNNNN.raw with the highest number, the one shown last
+static int check_last_file(const char *dir)
+{
+    char path[PATH_MAX];
+    char last[NAME_MAX + 1] = "";
+    struct dirent *dt;
+    uint32_t *shown, *file;
+    int res = 1;
+    FILE *f;
+    DIR *d;
+
+    fb_flush();
+
+    d = opendir(dir);
+    if(!d)
+    {
+        fprintf(stderr, "no frames in %s\n", dir);
+        return 1;
+    }
+    while((dt = readdir(d)))
+        if(strncmp(dt->d_name, "frame_", 6) == 0 && strcmp(dt->d_name, last) > 0)
+            snprintf(last, sizeof(last), "%s", dt->d_name);
+    closedir(d);
+
+    snprintf(path, sizeof(path), "%s/%s", dir, last);
+    f = fopen(path, "r");
+    if(!f)
+    {
+        fprintf(stderr, "failed to open %s\n", path);
+        return 1;
+    }
+
+    shown = host_fb_grab();
+    file = malloc(fb_width*fb_height*4);
+    if(fread(file, 4, fb_width*fb_height, f) == (size_t)(fb_width*fb_height))
+    {
+        int i;
+        for(i = 0; i < fb_width*fb_height; ++i)
+            file[i] |= 0xFF000000;
+        res = host_fb_diff(path, file, shown) != 0;
+    }
+    else
+        fprintf(stderr, "%s is too short\n", path);
+
+    fclose(f);
+    free(shown);
+    free(file);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    int steps = 600, seed = 1;
+    int i, fails = 0;
+    char what[32];
+    fb_stats s;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "n:r:")) != -1)
+    {
+        if(c == 'n')
+            steps = atoi(optarg);
+        else if(c == 'r')
+            seed = atoi(optarg);
+        else if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [options]\n" HOST_FB_USAGE
+                   "  -n STEPS            edits to make (600)\n"
+                   "  -r SEED             seed of the edits (1)\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    srand(seed);
+    for(i = 0; i < steps && fails < 4; ++i)
+    {
+        random_edit();
+        fb_draw();
+        if(rand()%5 == 0)
+        {
+            snprintf(what, sizeof(what), "step %d", i);
+            fails += host_fb_check_redraw(what) != 0;
+        }
+    }
+
+    fails += host_fb_check_redraw("end") != 0;
+    if(strncmp(opts.backend, "file:", 5) == 0)
+        fails += check_last_file(opts.backend + 5);
+
+    fb_get_stats(&s);
+    printf("check_damage: %d failed, %u frames, %llu px drawn, %llu px copied\n", fails, s.frames,
+           (unsigned long long)s.px_drawn_total, (unsigned long long)s.px_copied_total);
+
+    fb_clear();
+    host_fb_close();
+    return fails != 0;
+}
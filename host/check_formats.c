@@ -0,0 +1,133 @@
+/*
+ * Draws the same scene in every pixel format, with and without padded
+ * lines. 32bpp frames must have exactly the pixels of the RGBX8888 one,
+ * RGB565 frames the same pixels quantized to 5 and 6 bits. The msgbox dims
+ * RGB565 pixels after they were quantized, those can be one step off.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "util.h"
+
+#define W 640
+#define H 480
+
+// count of pixels of a which are more than one RGB565 step from b
+static int diff_565(const char *what, const uint32_t *a, const uint32_t *b)
+{
+    static const int step[3] = { 8, 4, 8 };
+    int i, c, d, n = 0;
+
+    for(i = 0; i < W*H; ++i)
+    {
+        for(c = 0; c < 3; ++c)
+        {
+            d = (int)((a[i] >> c*8) & 0xFF) - (int)((b[i] >> c*8) & 0xFF);
+            if(d > step[c] || d < -step[c])
+                break;
+        }
+        if(c == 3)
+            continue;
+        if(n++ < 3)
+            fprintf(stderr, "%s: %d,%d is %08X, expected %08X\n", what, i%W, i/W, a[i], b[i]);
+    }
+    if(n)
+        fprintf(stderr, "%s: %d pixels differ\n", what, n);
+    return n;
+}
+
+static uint32_t *draw_scene(host_fb_opts *opts)
+{
+    uint32_t *res;
+    int i;
+
+    if(host_fb_open(opts) < 0)
+        return NULL;
+
+    srand(5);
+    for(i = 0; i < 30; ++i)
+        fb_add_rect(rand()%W - 30, rand()%H - 30, rand()%200, rand()%200, rand() | 0xFF000000);
+    for(i = 0; i < 30; ++i)
+        fb_add_text(rand()%W, rand()%H, rand() | 0xFF000000, 1 + rand()%4, "Hey %d", i);
+    fb_draw();
+
+    // the msgbox dims everything under it
+    fb_create_msgbox(300, 200, 0xFF3366CC);
+    fb_msgbox_add_text(-1, -1, SIZE_BIG, "msg");
+    fb_draw();
+
+    res = host_fb_grab();
+    fb_clear();
+    host_fb_close();
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct
+    {
+        int format;
+        int line_length;
+    } formats[] = {
+        { FB_FMT_BGRX8888, 0 },
+        { FB_FMT_RGBX8888, W*4 + 64 },
+        { FB_FMT_BGRX8888, W*4 + 32 },
+        { FB_FMT_RGB565,   0 },
+        { FB_FMT_RGB565,   W*2 + 64 },
+    };
+    const fb_format *f565 = fb_format_get(FB_FMT_RGB565);
+    host_fb_opts opts;
+    uint32_t *ref, *px;
+    char what[64];
+    int i, k, fails = 0;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, "t:")) != -1)
+    {
+        if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [-t N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    opts.w = W;
+    opts.h = H;
+    ref = draw_scene(&opts);
+    if(!ref)
+        return 1;
+
+    for(i = 0; i < (int)(sizeof(formats)/sizeof(formats[0])); ++i)
+    {
+        opts.format = formats[i].format;
+        opts.line_length = formats[i].line_length;
+        px = draw_scene(&opts);
+        if(!px)
+            return 1;
+
+        snprintf(what, sizeof(what), "%s, %d bytes per line", fb_format_get(opts.format)->name,
+                 opts.line_length);
+
+        if(opts.format == FB_FMT_RGB565)
+        {
+            uint32_t *quant = malloc(W*H*4);
+            for(k = 0; k < W*H; ++k)
+                quant[k] = (*f565->to_color)((*f565->color)(ref[k])) | 0xFF000000;
+            fails += diff_565(what, px, quant) != 0;
+            free(quant);
+        }
+        else
+            fails += host_fb_diff(what, px, ref) != 0;
+        free(px);
+    }
+
+    free(ref);
+    printf("check_formats: %d failed\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Writes a raw icon with opaque, transparent and half transparent columns
+ * in every format, loads it and draws it cropped, clipped, moved and
+ * scrolled. Icons in the format of the framebuffer must be mmapped, the
+ * others converted to the same pixels.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "fb_image.h"
+#include "util.h"
+
+#define W 40
+#define H 30
+#define BG 0xFFFF0000
+
+static int fails = 0;
+
+#define CHECK(c) do { if(!(c)) { fprintf(stderr, "line %d: %s\n", __LINE__, #c); ++fails; } } while(0)
+
+// 0xAABBGGRR, opaque on the left, transparent and then half transparent white
+static uint32_t icon_color(int x, int y)
+{
+    if(x < 20)
+        return 0xFF000040 | ((x*6) << 16) | ((y*8) << 8);
+    if(x < 30)
+        return 0x00000000;
+    return 0x80FFFFFF;
+}
+
+static int write_icon(const char *path, int format)
+{
+    const fb_format *f = fb_format_get(format);
+    fb_raw_header hdr = { FB_RAW_MAGIC, W, H, format, FB_RAW_ALPHA };
+    uint32_t px;
+    int x, y;
+    FILE *out = fopen(path, "w");
+    if(!out)
+        return -1;
+
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    for(y = 0; y < H; ++y)
+    {
+        for(x = 0; x < W; ++x)
+        {
+            // the alpha is kept in the top byte, 16bpp pixels have none
+            px = (*f->color)(icon_color(x, y));
+            if(f->bpp == 4)
+                px = (px & 0x00FFFFFF) | (icon_color(x, y) & 0xFF000000);
+            fwrite(&px, f->bpp, 1, out);
+        }
+    }
+    fclose(out);
+    return 0;
+}
+
+// color c as it ends up in the framebuffer
+static uint32_t fb_color(uint32_t c)
+{
+    const fb_format *f = fb_format_get(fb_get_format());
+    return (*f->to_color)((*f->color)(c)) | 0xFF000000;
+}
+
+static uint32_t px_at(int x, int y)
+{
+    uint32_t *px = host_fb_grab();
+    uint32_t res = px[y*fb_width + x];
+    free(px);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    const char *dir = ".";
+    char paths[FB_FMT_COUNT][256];
+    char *icon;
+    fb_img *img[FB_FMT_COUNT];
+    fb_bbox clip = { 0, 0, 300, 150 };
+    fb_image *im, *cropped, *clipped;
+    uint32_t half;
+    int i, fmt;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "d:")) != -1)
+    {
+        if(c == 'd')
+            dir = optarg;
+        else if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [options]\n" HOST_FB_USAGE
+                   "  -d DIR              where to write the icons (.)\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for(i = 0; i < FB_FMT_COUNT; ++i)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "%s/icon_%s.raw", dir, fb_format_get(i)->name);
+        if(write_icon(paths[i], i) < 0)
+        {
+            fprintf(stderr, "failed to write %s\n", paths[i]);
+            return 1;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    // loading: native icons are mmapped, the same pixels either way
+    fmt = fb_get_format();
+    for(i = 0; i < FB_FMT_COUNT; ++i)
+    {
+        img[i] = fb_img_get(paths[i], fmt);
+        CHECK(img[i] && img[i]->w == W && img[i]->h == H);
+        CHECK(img[i] && (img[i]->map != NULL) == (i == fmt));
+    }
+    for(i = 0; i < FB_FMT_COUNT; ++i)
+    {
+        // 16bpp icons have no alpha, compare only the opaque pixels
+        if(img[i] && img[fmt] && fb_format_get(i)->bpp == 4)
+            CHECK(memcmp(img[i]->px, img[fmt]->px, img[fmt]->stride*H) == 0);
+        fb_img_put(img[i]);
+    }
+    icon = paths[FB_FMT_RGBX8888];
+
+    // drawing: alpha over the background
+    fb_add_rect(0, 0, 300, 300, BG);
+    im = fb_add_image(10, 20, icon);
+    CHECK(im != NULL);
+    fb_draw();
+    CHECK(px_at(10, 20) == fb_color(icon_color(0, 0)));
+    CHECK(px_at(10 + 19, 20 + 29) == fb_color(icon_color(19, 29)));
+    CHECK(px_at(10 + 25, 20 + 5) == fb_color(BG));
+    half = px_at(10 + 35, 20 + 5);
+    CHECK((half & 0xFF) > 0x60 && (half & 0xFF) < 0xA0);
+    CHECK(host_fb_check_redraw("image") == 0);
+
+    // cropped and clipped from the first frame
+    cropped = fb_add_image_clipped(NULL, 100, 100, 10, 5, icon);
+    clipped = fb_add_image_clipped(&clip, 200, 140, -1, -1, icon);
+    CHECK(cropped && cropped->w == 10 && cropped->h == 5);
+    fb_draw();
+    CHECK(px_at(100 + 9, 100 + 4) == fb_color(icon_color(9, 4)));
+    CHECK(px_at(100 + 10, 100) == fb_color(BG));
+    CHECK(px_at(100, 100 + 5) == fb_color(BG));
+    CHECK(px_at(200, 149) == fb_color(icon_color(0, 9)));
+    CHECK(px_at(200, 150) == fb_color(BG));
+    CHECK(host_fb_check_redraw("cropped and clipped") == 0);
+
+    // moved, scrolled and removed
+    im->head.y = 200;
+    fb_draw();
+    CHECK(px_at(10, 20) == fb_color(BG));
+    CHECK(px_at(10, 200) == fb_color(icon_color(0, 0)));
+    CHECK(host_fb_check_redraw("moved") == 0);
+
+    fb_scroll(0, 0, 400, 600, -50);
+    im->head.y -= 50;
+    fb_draw();
+    CHECK(px_at(10, 150) == fb_color(icon_color(0, 0)));
+    CHECK(host_fb_check_redraw("scrolled") == 0);
+
+    fb_rm_image(im);
+    fb_rm_image(cropped);
+    fb_rm_image(clipped);
+    fb_draw();
+    CHECK(px_at(10, 150) == fb_color(BG));
+    CHECK(host_fb_check_redraw("removed") == 0);
+
+    fb_clear();
+    host_fb_close();
+    fb_img_cache_clear();
+
+    printf("check_image: %d failed\n", fails);
+    return fails != 0;
+}
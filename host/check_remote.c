@@ -0,0 +1,145 @@
+/*
+ * Serves a changing scene with the remote framebuffer server and runs
+ * tools/fb_remote_client against it. The last frame the client rebuilds
+ * from the tiles must have exactly the bytes of the shown frame.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "fb_remote.h"
+#include "util.h"
+
+#define RECTS 20
+
+static int compare(const char *path)
+{
+    const int bpp = fb_format_get(fb_get_format())->bpp;
+    const int line = fb_width*bpp;
+    char *frame, *got;
+    int y, res = 0;
+    FILE *f;
+
+    got = malloc(line*fb_height);
+    f = fopen(path, "r");
+    if(!f || fread(got, line, fb_height, f) != (size_t)fb_height)
+    {
+        fprintf(stderr, "%s is missing or short\n", path);
+        if(f)
+            fclose(f);
+        free(got);
+        return 1;
+    }
+    fclose(f);
+
+    fb_clone(&frame);
+    for(y = 0; y < fb_height; ++y)
+    {
+        if(memcmp(got + y*line, frame + y*fb->fi.line_length, line) != 0)
+        {
+            fprintf(stderr, "line %d of the client's frame differs\n", y);
+            res = 1;
+            break;
+        }
+    }
+    free(frame);
+    free(got);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    const char *client = "out/fb_remote_client";
+    const char *dir = ".";
+    char path[256], port_arg[16];
+    fb_rect *rects[RECTS];
+    fb_text *text;
+    int i, step, port = 18787, status, fails = 0;
+    pid_t pid;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "c:d:P:")) != -1)
+    {
+        switch(c)
+        {
+            case 'c': client = optarg; break;
+            case 'd': dir = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            default:
+                if(host_fb_parse_opt(&opts, c, optarg) < 0)
+                {
+                    printf("usage: %s [options]\n" HOST_FB_USAGE
+                           "  -c PATH             the client (out/fb_remote_client)\n"
+                           "  -d DIR              where the client writes the frame (.)\n"
+                           "  -P PORT             port of the server (18787)\n", argv[0]);
+                    return 1;
+                }
+                break;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    srand(4);
+    for(i = 0; i < RECTS; ++i)
+        rects[i] = fb_add_rect(rand()%fb_width, rand()%fb_height, 20 + rand()%200, 20 + rand()%200, rand() | 0xFF000000);
+    text = fb_add_text(50, 50, WHITE, SIZE_BIG, "frame 0");
+    fb_draw();
+
+    if(fb_remote_start(port) < 0)
+        return 1;
+
+    snprintf(path, sizeof(path), "%s/remote.raw", dir);
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+    unlink(path);
+
+    pid = fork();
+    if(pid == 0)
+    {
+        execl(client, client, "-p", port_arg, "-r", "-o", path, "-i", "1000", (char*)NULL);
+        fprintf(stderr, "failed to run %s\n", client);
+        _exit(1);
+    }
+
+    // the first frame is whole, the next ones only the changed tiles
+    usleep(300000);
+    for(step = 1; step <= 12; ++step)
+    {
+        for(i = 0; i < 3; ++i)
+        {
+            c = rand()%RECTS;
+            rects[c]->head.x = rand()%fb_width;
+            rects[c]->color = rand() | 0xFF000000;
+        }
+        fb_text_set(text, step % 2 ? "odd frame" : "even frame");
+        if(step % 4 == 0)
+            fb_scroll(0, 0, fb_width, fb_height/2, 30);
+        fb_draw();
+        usleep(80000);
+    }
+    fb_flush();
+
+    if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "the client failed\n");
+        ++fails;
+    }
+    else
+        fails += compare(path);
+
+    fb_remote_stop();
+    fb_clear();
+    host_fb_close();
+
+    printf("check_remote: %d failed\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Takes screenshots of two different frames, the QOI files written in the
+ * background must have the pixels of the frames as they were shown when
+ * they were taken, numbered after the files already in the directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "fb_image.h"
+#include "screenshot.h"
+#include "util.h"
+
+static int fails = 0;
+
+#define CHECK(c) do { if(!(c)) { fprintf(stderr, "line %d: %s\n", __LINE__, #c); ++fails; } } while(0)
+
+static void clean_dir(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *dt;
+    DIR *d;
+
+    mkdir(dir, 0777);
+    d = opendir(dir);
+    if(!d)
+        return;
+    while((dt = readdir(d)))
+    {
+        if(strncmp(dt->d_name, "screenshot_", 11) != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, dt->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+static int check_file(const char *dir, int n, const uint32_t *ref)
+{
+    char path[PATH_MAX];
+    fb_img *img;
+    int i, res;
+
+    snprintf(path, sizeof(path), "%s/screenshot_%02d.qoi", dir, n);
+    img = fb_img_get(path, FB_FMT_RGBX8888);
+    if(!img)
+    {
+        fprintf(stderr, "%s was not written\n", path);
+        return 1;
+    }
+
+    for(i = 0; i < img->w*img->h; ++i)
+        ((uint32_t*)img->px)[i] |= 0xFF000000;
+    res = img->w != fb_width || img->h != fb_height || host_fb_diff(path, (uint32_t*)img->px, ref) != 0;
+    fb_img_put(img);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    const char *dir = "shots";
+    char path[PATH_MAX];
+    uint32_t *first, *second;
+    FILE *f;
+    int i;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "d:")) != -1)
+    {
+        if(c == 'd')
+            dir = optarg;
+        else if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [options]\n" HOST_FB_USAGE
+                   "  -d DIR              where to write the screenshots (shots)\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // numbering continues after the last file
+    clean_dir(dir);
+    snprintf(path, sizeof(path), "%s/screenshot_07.qoi", dir);
+    f = fopen(path, "w");
+    if(f)
+        fclose(f);
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    srand(3);
+    for(i = 0; i < 40; ++i)
+        fb_add_rect(rand()%fb_width, rand()%fb_height, rand()%300, rand()%300, rand() | 0xFF000000);
+    for(i = 0; i < 40; ++i)
+        fb_add_text(rand()%fb_width, rand()%fb_height, rand() | 0xFF000000, 1 + rand()%4, "Text %d", i);
+    fb_draw();
+
+    first = host_fb_grab();
+    CHECK(screenshot_take(dir) == 0);
+
+    // the screenshot has the frame from when it was taken
+    fb_add_rect(0, 0, fb_width/2, fb_height/2, 0xFF00FF00);
+    fb_draw();
+    second = host_fb_grab();
+    CHECK(screenshot_take(dir) == 0);
+
+    screenshot_flush();
+    CHECK(check_file(dir, 8, first) == 0);
+    CHECK(check_file(dir, 9, second) == 0);
+
+    free(first);
+    free(second);
+    fb_clear();
+    host_fb_close();
+    fb_img_cache_clear();
+
+    printf("check_screenshot: %d failed\n", fails);
+    return fails != 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Scrolls rows of clipped items through an area with fb_scroll(), like the
+ * ROM list does. The shown frame must be the same as a full redraw and
+ * nothing of the rows may be drawn outside of the area.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "util.h"
+
+#define ROWS 60
+#define ROW_H 100
+#define AREA_X 0
+#define AREA_Y 100
+#define AREA_W 700
+#define AREA_H 1000
+
+static fb_bbox clip = { AREA_X, AREA_Y, AREA_W, AREA_H };
+static fb_text *texts[ROWS];
+static fb_rect *lines[ROWS];
+static fb_rect *boxes[ROWS];
+static int pos = 0;
+static int msgbox = 0;
+
+static void layout(void)
+{
+    char name[32];
+    int i, y, visible;
+
+    for(i = 0; i < ROWS; ++i)
+    {
+        y = AREA_Y + i*ROW_H - pos;
+        visible = (y + ROW_H > AREA_Y && y < AREA_Y + AREA_H);
+
+        if(!visible && texts[i])
+        {
+            fb_rm_text(texts[i]);
+            fb_rm_rect(lines[i]);
+            fb_rm_rect(boxes[i]);
+            texts[i] = NULL;
+        }
+        else if(visible && !texts[i])
+        {
+            snprintf(name, sizeof(name), "ROM number %d", i);
+            texts[i] = fb_add_text_clipped(&clip, AREA_X + 100, y + 30, WHITE, SIZE_BIG, name);
+            lines[i] = fb_add_rect_clipped(&clip, AREA_X, y + ROW_H - 2, AREA_W, 1, 0xFF1B1B1B);
+            boxes[i] = fb_add_rect_clipped(&clip, AREA_X + 30, y + 35, 30, 30, 0xFF00AA00 + i);
+        }
+        else if(visible)
+        {
+            texts[i]->head.y = y + 30;
+            lines[i]->head.y = y + ROW_H - 2;
+            boxes[i]->head.y = y + 35;
+        }
+    }
+}
+
+// the rows must not leak out of the area, left of the scroll mark
+static int check_overdraw(void)
+{
+    uint32_t *px = host_fb_grab();
+    int x, y, res = 0;
+
+    for(y = 0; y < fb_height && !res; ++y)
+    {
+        if(y >= AREA_Y && y < AREA_Y + AREA_H)
+            continue;
+        for(x = 0; x < AREA_W; ++x)
+        {
+            if(px[y*fb_width + x] != BLACK)
+            {
+                fprintf(stderr, "overdraw at %d,%d: %08X\n", x, y, px[y*fb_width + x]);
+                res = 1;
+                break;
+            }
+        }
+    }
+    free(px);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    int step, k, n, dy, next, steps = 500;
+    int fails = 0, max = ROWS*ROW_H - AREA_H;
+    uint64_t drawn = 0;
+    fb_stats s0, s1;
+    fb_rect *mark;
+    char what[32];
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "n:")) != -1)
+    {
+        if(c == 'n')
+            steps = atoi(optarg);
+        else if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [options]\n" HOST_FB_USAGE
+                   "  -n STEPS            scroll steps (500)\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    srand(1);
+
+    // crosses the edge of the area, and one inside of it which doesn't scroll
+    fb_add_rect(AREA_W - 50, 500, 100, 40, 0xFF0000FF);
+    fb_add_text(400, 600, 0xFF00FFFF, SIZE_NORMAL, "static");
+    mark = fb_add_rect(AREA_W + 20, AREA_Y, 10, 50, GRAY);
+
+    layout();
+    fb_draw();
+
+    for(step = 0; step < steps && fails < 4; ++step)
+    {
+        dy = rand()%81 - 40;
+        n = (rand()%5 == 0) ? 2 : 1;
+        for(k = 0; k < n; ++k)
+        {
+            next = imin(imax(pos + dy, 0), max);
+            fb_scroll(AREA_X, AREA_Y, AREA_W, AREA_H, pos - next);
+            pos = next;
+            layout();
+        }
+        mark->head.y = AREA_Y + (AREA_H - 50)*pos/max;
+
+        switch(rand()%20)
+        {
+            case 0:
+                k = rand()%ROWS;
+                if(boxes[k])
+                    boxes[k]->color = rand();
+                break;
+            case 1:
+                // outside of the area, the frame falls back to a redraw
+                fb_scroll(0, 0, 200, 90, 5);
+                break;
+            case 2:
+                msgbox = !msgbox;
+                if(msgbox)
+                {
+                    fb_create_msgbox(400, 200, 0xFF333333);
+                    fb_msgbox_add_text(-1, -1, SIZE_NORMAL, "box");
+                }
+                else
+                    fb_destroy_msgbox();
+                break;
+        }
+
+        fb_get_stats(&s0);
+        fb_draw();
+        fb_flush();
+        fb_get_stats(&s1);
+        drawn += s1.px_drawn_total - s0.px_drawn_total;
+
+        if(step % 7 == 6)
+        {
+            snprintf(what, sizeof(what), "step %d", step);
+            fails += host_fb_check_redraw(what) != 0;
+            if(!msgbox)
+                fails += check_overdraw();
+        }
+    }
+
+    fails += host_fb_check_redraw("end") != 0;
+    printf("check_scroll: %d failed, %llu px drawn per scroll frame, the area has %d\n",
+           fails, (unsigned long long)(drawn/imax(step, 1)), AREA_W*AREA_H);
+
+    fb_clear();
+    host_fb_close();
+    return fails != 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Moves rows of a clipped widget tree around, selects their checkboxes and
+ * adds and destroys rows. The shown frame must be the same as a full
+ * redraw, and rows must be clipped from the first frame they are in.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "widget.h"
+#include "checkbox.h"
+#include "util.h"
+
+#define ROWS 30
+#define ROW_H 100
+
+static fb_bbox clip = { 0, 100, 700, 1000 };
+
+static int check_clip(const char *what)
+{
+    uint32_t *px = host_fb_grab();
+    int x, y, res = 0;
+
+    for(y = 0; y < fb_height && !res; ++y)
+    {
+        if(y >= clip.y && y < clip.y + clip.h)
+            continue;
+        for(x = 0; x < fb_width; ++x)
+        {
+            if(px[y*fb_width + x] != BLACK)
+            {
+                fprintf(stderr, "%s: drawn outside of the clip at %d,%d\n", what, x, y);
+                res = 1;
+                break;
+            }
+        }
+    }
+    free(px);
+    return res;
+}
+
+static widget *add_row(widget *parent, int i, checkbox **box)
+{
+    widget *row = widget_create(parent, 0, i*ROW_H);
+    widget_add_text(row, 100, 30, WHITE, SIZE_BIG, "row");
+    widget_add_rect(row, 0, ROW_H - 2, 700, 1, 0xFF1B1B1B);
+    *box = checkbox_create(row, 30, 35, NULL);
+    checkbox_select(*box, i % 2);
+    return row;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    widget *root, *rows, *r[ROWS];
+    checkbox *boxes[ROWS];
+    int i, k, step, fails = 0;
+    char what[32];
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS)) != -1)
+    {
+        if(host_fb_parse_opt(&opts, c, optarg) < 0)
+        {
+            printf("usage: %s [options]\n" HOST_FB_USAGE, argv[0]);
+            return 1;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    srand(1);
+
+    root = widget_create(NULL, 0, 0);
+    rows = widget_create(root, 0, 100);
+    widget_set_clip(rows, &clip);
+    for(i = 0; i < ROWS; ++i)
+        r[i] = add_row(rows, i, &boxes[i]);
+
+    fb_draw();
+    fails += check_clip("first frame");
+
+    for(step = 0; step < 200 && fails < 4; ++step)
+    {
+        k = rand() % ROWS;
+        widget_move(rows, 0, 100 - rand()%2000);
+        checkbox_select(boxes[k], rand()%2);
+        if(rand()%10 == 0)
+        {
+            // new rows must be clipped in the frame which shows them first
+            checkbox_destroy(boxes[k]);
+            widget_destroy(r[k]);
+            r[k] = add_row(rows, k, &boxes[k]);
+        }
+        fb_draw();
+
+        snprintf(what, sizeof(what), "step %d", step);
+        fails += check_clip(what);
+        fails += host_fb_check_redraw(what) != 0;
+    }
+
+    for(i = 0; i < ROWS; i += 2)
+    {
+        checkbox_destroy(boxes[i]);
+        widget_destroy(r[i]);
+    }
+    fb_draw();
+    fails += host_fb_check_redraw("destroyed rows") != 0;
+
+    widget_destroy(root);
+    fb_draw();
+    fails += host_fb_check_redraw("destroyed tree") != 0;
+
+    printf("check_widget: %d failed\n", fails);
+    host_fb_close();
+    return fails != 0;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_fb.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "util.h"
+
+static fb_backend *host_backend = NULL;
+
+void host_fb_init_opts(host_fb_opts *o)
+{
+    memset(o, 0, sizeof(host_fb_opts));
+    o->backend = "memory";
+    o->w = 800;
+    o->h = 1280;
+    o->format = FB_FMT_RGBX8888;
+    o->threads = 1;
+}
+
+int host_fb_parse_opt(host_fb_opts *o, int c, const char *arg)
+{
+    switch(c)
+    {
+        case 'b':
+            if(strcmp(arg, "memory") != 0 && strncmp(arg, "file:", 5) != 0)
+                return -1;
+            o->backend = arg;
+            return 0;
+        case 's':
+            if(sscanf(arg, "%dx%d", &o->w, &o->h) != 2 || o->w <= 0 || o->h <= 0)
+                return -1;
+            return 0;
+        case 'f':
+            o->format = atoi(arg);
+            return fb_format_get(o->format) ? 0 : -1;
+        case 'l':
+            o->line_length = atoi(arg);
+            return 0;
+        case 't':
+            o->threads = atoi(arg);
+            return o->threads > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+int host_fb_open(host_fb_opts *o)
+{
+    if(strncmp(o->backend, "file:", 5) == 0)
+    {
+        if(o->format != FB_FMT_RGBX8888 || o->line_length)
+        {
+            fprintf(stderr, "the file backend writes only unpadded RGBX8888 frames\n");
+            return -1;
+        }
+        host_backend = fb_backend_file(o->backend + 5, o->w, o->h);
+    }
+    else
+        host_backend = fb_backend_memory_fmt(o->w, o->h, o->format, o->line_length);
+
+    if(!host_backend)
+        return -1;
+
+    fb_set_backend(host_backend);
+    fb_set_render_threads(o->threads);
+    return fb_open();
+}
+
+void host_fb_close(void)
+{
+    fb_close();
+    fb_set_backend(NULL);
+    fb_backend_destroy(host_backend);
+    host_backend = NULL;
+}
+
+uint32_t *host_fb_grab(void)
+{
+    const fb_format *f = fb_format_get(fb_get_format());
+    int stride = fb->fi.line_length;
+    uint32_t *res = malloc(fb_width*fb_height*4);
+    uint32_t *p = res;
+    uint32_t px;
+    uint8_t *line;
+    char *frame;
+    int x, y;
+
+    fb_clone(&frame);
+    for(y = 0; y < fb_height; ++y)
+    {
+        line = (uint8_t*)frame + y*stride;
+        for(x = 0; x < fb_width; ++x)
+        {
+            px = f->bpp == 4 ? ((uint32_t*)line)[x] : ((uint16_t*)line)[x];
+            *p++ = (*f->to_color)(px) | 0xFF000000;
+        }
+    }
+    free(frame);
+    return res;
+}
+
+int host_fb_diff(const char *what, const uint32_t *a, const uint32_t *b)
+{
+    int i, n = 0;
+    for(i = 0; i < fb_width*fb_height; ++i)
+    {
+        if(a[i] == b[i])
+            continue;
+        if(n++ < 3)
+            fprintf(stderr, "%s: %d,%d is %08X, expected %08X\n", what, i%fb_width, i/fb_width, a[i], b[i]);
+    }
+    if(n)
+        fprintf(stderr, "%s: %d pixels differ\n", what, n);
+    return n;
+}
+
+int host_fb_check_redraw(const char *what)
+{
+    uint32_t *shown, *full;
+    int res;
+
+    fb_flush();
+    shown = host_fb_grab();
+
+    fb_invalidate();
+    fb_draw();
+    full = host_fb_grab();
+
+    res = host_fb_diff(what, shown, full);
+    free(shown);
+    free(full);
+    return res;
+}
+
+int host_fb_write_ppm(const char *path, const uint32_t *px)
+{
+    FILE *f = fopen(path, "w");
+    int i;
+
+    if(!f)
+    {
+        fprintf(stderr, "failed to open %s\n", path);
+        return -1;
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", fb_width, fb_height);
+    for(i = 0; i < fb_width*fb_height; ++i)
+    {
+        fputc(px[i] & 0xFF, f);
+        fputc((px[i] >> 8) & 0xFF, f);
+        fputc((px[i] >> 16) & 0xFF, f);
+    }
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef HOST_FB_H
+#define HOST_FB_H
+
+#include <stdint.h>
+
+// Framebuffer setup shared by the host programs. They all take the same
+// options, so every check can run on each backend, format and thread count:
+//   -b memory|file:DIR  backend, file writes every shown frame into DIR
+//   -s WxH              screen size, grouper's 800x1280 by default
+//   -f FMT              FB_FMT_* of the memory backend
+//   -l BYTES            line length, for padded lines
+//   -t N                render threads
+#define HOST_FB_OPTS "b:s:f:l:t:"
+#define HOST_FB_USAGE \
+    "  -b memory|file:DIR  framebuffer backend (memory)\n" \
+    "  -s WxH              screen size (800x1280)\n" \
+    "  -f FMT              FB_FMT_* of the frames (0, RGBX8888)\n" \
+    "  -l BYTES            line length (no padding)\n" \
+    "  -t N                render threads\n"
+
+typedef struct
+{
+    const char *backend;
+    int w, h;
+    int format;
+    int line_length;
+    int threads;
+} host_fb_opts;
+
+void host_fb_init_opts(host_fb_opts *o);
+// returns -1 if c is not one of HOST_FB_OPTS or its argument is wrong
+int host_fb_parse_opt(host_fb_opts *o, int c, const char *arg);
+int host_fb_open(host_fb_opts *o);
+void host_fb_close(void);
+
+// Shown frame with pixels converted to 0xAABBGGRR, w*h of them with alpha
+// forced to 0xFF, so frames of all formats and strides compare directly.
+// The caller frees it.
+uint32_t *host_fb_grab(void);
+// returns the count of differing pixels and logs the first few
+int host_fb_diff(const char *what, const uint32_t *a, const uint32_t *b);
+// Flushes and compares the shown frame with a full redraw of the same
+// scene, which is what damage tracking, scrolling and clipping must
+// produce. Returns the count of differing pixels.
+int host_fb_check_redraw(const char *what);
+int host_fb_write_ppm(const char *path, const uint32_t *px);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "host_ui.h"
+#include "framebuffer.h"
+#include "listview.h"
+#include "util.h"
+
+// multirom_ui.c is not built on the host, the widgets only need its colors
+uint32_t CLR_PRIMARY = LBLUE;
+uint32_t CLR_SECONDARY = LBLUE2;
+
+// ROM tab layout of multirom_ui.c
+#define LIST_Y (75 + 90)
+#define LIST_FOOTER (130 + 20)
+#define SCROLL_STEP 37
+
+listview *host_list_create(int rows, const char *icon)
+{
+    listview *view = malloc(sizeof(listview));
+    char name[32];
+    int i;
+
+    memset(view, 0, sizeof(listview));
+    view->y = LIST_Y;
+    view->w = fb_width;
+    view->h = fb_height - LIST_Y - LIST_FOOTER;
+    view->item_draw = &rom_item_draw;
+    view->item_hide = &rom_item_hide;
+    view->item_height = &rom_item_height;
+    view->item_destroy = &rom_item_destroy;
+
+    listview_init_ui(view);
+
+    for(i = 0; i < rows; ++i)
+    {
+        snprintf(name, sizeof(name), "ROM number %d", i);
+        listview_add_item(view, i, rom_item_create(name, (i % 3) ? NULL : "USB drive", icon));
+    }
+
+    if(view->items)
+        listview_select_item(view, view->items[0]);
+    listview_update_ui(view);
+    return view;
+}
+
+void host_list_scroll(listview *view, int steps)
+{
+    int i, dy = SCROLL_STEP;
+
+    for(i = 0; i < steps; ++i)
+    {
+        if(view->pos + dy > view->fullH - view->h || view->pos + dy < 0)
+            dy = -dy;
+        listview_scroll_by(view, dy);
+
+        if(i % 10 == 0 && view->items)
+        {
+            listview_select_item(view, view->items[(i/10) % list_item_count(view->items)]);
+            listview_update_ui(view);
+        }
+        fb_flush();
+    }
+}
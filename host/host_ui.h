@@ -0,0 +1,15 @@
+#ifndef HOST_UI_H
+#define HOST_UI_H
+
+#include "listview.h"
+
+// ROM list of multirom_ui.c's ROM tab with rows ROMs, every third on a
+// USB drive, icon can be NULL
+listview *host_list_create(int rows, const char *icon);
+// Scrolls the list up and down for steps frames and selects another row
+// every 10 of them. Every step is flushed as its own frame, so the time
+// per frame is what the scroll costs and not the frame rate of the
+// render thread.
+void host_list_scroll(listview *view, int steps);
+
+#endif
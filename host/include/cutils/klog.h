@@ -0,0 +1,12 @@
+#ifndef HOST_CUTILS_KLOG_H
+#define HOST_CUTILS_KLOG_H
+
+#include <stdio.h>
+
+// there is no kmsg to log to on the host
+#define KLOG_ERROR(tag, x...) fprintf(stderr, x)
+#define KLOG_NOTICE(tag, x...) fprintf(stderr, x)
+
+static inline void klog_init(void) { }
+
+#endif
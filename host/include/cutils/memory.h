@@ -0,0 +1,22 @@
+#ifndef HOST_CUTILS_MEMORY_H
+#define HOST_CUTILS_MEMORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// size is in bytes, like in libcutils
+static inline void android_memset16(uint16_t *dst, uint16_t value, size_t size)
+{
+    size >>= 1;
+    while(size--)
+        *dst++ = value;
+}
+
+static inline void android_memset32(uint32_t *dst, uint32_t value, size_t size)
+{
+    size >>= 2;
+    while(size--)
+        *dst++ = value;
+}
+
+#endif
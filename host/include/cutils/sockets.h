@@ -0,0 +1,7 @@
+#ifndef HOST_CUTILS_SOCKETS_H
+#define HOST_CUTILS_SOCKETS_H
+
+#define ANDROID_SOCKET_ENV_PREFIX "ANDROID_SOCKET_"
+#define ANDROID_SOCKET_DIR "/dev/socket"
+
+#endif
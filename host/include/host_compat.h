@@ -0,0 +1,13 @@
+#ifndef HOST_COMPAT_H
+#define HOST_COMPAT_H
+
+// Bionic headers include these from each other, so the sources get away
+// without including them. glibc ones don't, every host file gets them here.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_ANDROID_FILESYSTEM_CONFIG_H
+#define HOST_ANDROID_FILESYSTEM_CONFIG_H
+
+// decode_uid() in util.c looks names up in this, the host needs only a few
+#define AID_ROOT   0
+#define AID_SYSTEM 1000
+#define AID_SHELL  2000
+
+struct android_id_info
+{
+    const char *name;
+    unsigned aid;
+};
+
+static const struct android_id_info android_ids[] = {
+    { "root",   AID_ROOT },
+    { "system", AID_SYSTEM },
+    { "shell",  AID_SHELL },
+};
+#define android_id_count (sizeof(android_ids)/sizeof(android_ids[0]))
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Runs the ROM list or pong on a headless framebuffer and reports what the
+ * frames cost, the same code the device runs without the device. The last
+ * frame can be written out as PPM to look at or to diff.
+ *
+ * Instead of the scripted scrolling, the list or pong can be driven by an
+ * input recording, made on the device with record_input=1 in multirom.ini
+ * or written here with -w, so a session is a repeatable benchmark.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <linux/input.h>
+
+#include "host_fb.h"
+#include "host_ui.h"
+#include "framebuffer.h"
+#include "listview.h"
+#include "input.h"
+#include "pong.h"
+#include "util.h"
+
+static void usage(const char *name)
+{
+    printf("usage: %s [options]\n"
+           HOST_FB_USAGE
+           "  -n ROWS             rows of the ROM list (30)\n"
+           "  -i PATH             icon of the ROMs\n"
+           "  -m                  show a msgbox over the list\n"
+           "  -p                  play pong instead of showing the list\n"
+           "  -S STEPS            scroll the list up and down for STEPS frames,\n"
+           "                      or play pong for STEPS*16 ms (200)\n"
+           "  -o FILE             write the last frame as PPM\n"
+           "  -r FILE             replay an input recording instead of scrolling,\n"
+           "                      as fast as the UI takes it\n"
+           "  -R                  replay with the recorded timing, pong always does\n"
+           "  -w FILE             write a recording of STEPS swipes and exit\n", name);
+}
+
+static void rec_write(FILE *f, uint32_t dt_us, int type, int code, int value)
+{
+    input_rec_event e = { dt_us, type, code, value };
+    fwrite(&e, sizeof(e), 1, f);
+}
+
+// Swipes up and down over the middle of the screen, one touch report
+// every 8 ms. Positions are in screen pixels, the ranges are the screen.
+static int write_swipes(const char *path, int swipes)
+{
+    input_rec_header hdr = { INPUT_REC_MAGIC, INPUT_REC_VERSION,
+        { 0, fb_width - 1 }, { 0, fb_height - 1 }, 0 };
+    int i, k, y0, y1;
+    FILE *f = fopen(path, "w");
+    if(!f)
+    {
+        fprintf(stderr, "failed to open %s\n", path);
+        return -1;
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    for(i = 0; i < swipes; ++i)
+    {
+        y0 = (i & 1) ? fb_height/4 : fb_height*3/4;
+        y1 = fb_height - y0;
+
+        rec_write(f, 300000, EV_ABS, ABS_MT_TRACKING_ID, i);
+        for(k = 0; k <= 30; ++k)
+        {
+            if(k != 0)
+                rec_write(f, 8000, EV_ABS, ABS_MT_POSITION_X, fb_width/4 + fb_width*k/60);
+            else
+                rec_write(f, 0, EV_ABS, ABS_MT_POSITION_X, fb_width/4);
+            rec_write(f, 0, EV_ABS, ABS_MT_POSITION_Y, y0 + (y1 - y0)*k/30);
+            rec_write(f, 0, EV_SYN, SYN_REPORT, 0);
+        }
+        rec_write(f, 8000, EV_ABS, ABS_MT_TRACKING_ID, -1);
+        rec_write(f, 0, EV_SYN, SYN_REPORT, 0);
+    }
+    return fclose(f);
+}
+
+// Goes before the list's handler and renders what the previous touch
+// report changed, so that a fast replay is a frame per report like
+// host_list_scroll() and not whatever the render thread coalesces.
+static int flush_touch_handler(touch_event *ev, void *data)
+{
+    fb_flush();
+    return -1;
+}
+
+static int replaying = 0;
+static int replayed = 0;
+
+// pong runs until the power key, after STEPS*16 ms or the end of the replay
+static void *pong_stop_thread(void *data)
+{
+    if(replaying)
+        replayed = input_replay_wait();
+    else
+        usleep(*(int*)data * 16000);
+    input_inject_key(KEY_POWER);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    host_fb_opts opts;
+    const char *icon = NULL;
+    const char *ppm = NULL;
+    const char *replay = NULL;
+    const char *rec = NULL;
+    int rows = 30, msgbox = 0, play_pong = 0, steps = 200, realtime = 0;
+    listview *view = NULL;
+    pthread_t stopper;
+    fb_stats s;
+    uint64_t start, us;
+    int c;
+
+    host_fb_init_opts(&opts);
+    while((c = getopt(argc, argv, HOST_FB_OPTS "n:i:mpS:o:r:Rw:h")) != -1)
+    {
+        switch(c)
+        {
+            case 'n': rows = atoi(optarg); break;
+            case 'i': icon = optarg; break;
+            case 'm': msgbox = 1; break;
+            case 'p': play_pong = 1; break;
+            case 'S': steps = atoi(optarg); break;
+            case 'o': ppm = optarg; break;
+            case 'r': replay = optarg; break;
+            case 'R': realtime = 1; break;
+            case 'w': rec = optarg; break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                if(host_fb_parse_opt(&opts, c, optarg) < 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+        }
+    }
+
+    if(host_fb_open(&opts) < 0)
+        return 1;
+
+    if(rec)
+    {
+        c = write_swipes(rec, steps);
+        host_fb_close();
+        return c != 0;
+    }
+
+    // pong and the recordings are deterministic only with the same seed
+    srand(1);
+    start_input_thread();
+    start = gettime_us();
+
+    if(play_pong)
+    {
+        // the game runs on the clock, so the replay does as well. pong
+        // adds its touch handler once it runs, before the first touch
+        // of the recording is due.
+        if(replay)
+            replaying = (input_replay_start(replay, 1) >= 0);
+        pthread_create(&stopper, NULL, pong_stop_thread, &steps);
+        pong();
+        pthread_join(stopper, NULL);
+    }
+    else
+    {
+        if(replay && !realtime)
+            add_touch_handler(&flush_touch_handler, NULL);
+        view = host_list_create(rows, icon);
+        if(msgbox)
+        {
+            fb_create_msgbox(500, 250, DRED);
+            fb_msgbox_add_text(-1, -1, SIZE_NORMAL, "Booting ROM...");
+        }
+
+        if(!replay)
+            host_list_scroll(view, steps);
+        else if((replaying = (input_replay_start(replay, realtime) >= 0)))
+            replayed = input_replay_wait();
+    }
+
+    if(replay && !realtime && !play_pong)
+        rm_touch_handler(&flush_touch_handler, NULL);
+
+    if(replay && !replaying)
+    {
+        stop_input_thread();
+        if(view)
+            listview_destroy(view);
+        fb_clear();
+        host_fb_close();
+        return 1;
+    }
+
+    fb_flush();
+    us = gettime_us() - start;
+    stop_input_thread();
+
+    fb_get_stats(&s);
+    // what the frames took to render is in the fb timing log of fb_close()
+    printf("%u frames for %u fb_draw() calls in %llu ms\n",
+           s.frames, s.frames_requested, (unsigned long long)us/1000);
+    if(replaying)
+        printf("%d input events replayed\n", replayed);
+    printf("%llu px drawn, %llu px copied, %llu allocations\n",
+           (unsigned long long)s.px_drawn_total, (unsigned long long)s.px_copied_total,
+           (unsigned long long)s.allocs_total);
+
+    if(ppm)
+    {
+        uint32_t *px = host_fb_grab();
+        host_fb_write_ppm(ppm, px);
+        free(px);
+    }
+
+    if(view)
+        listview_destroy(view);
+    fb_clear();
+    host_fb_close();
+    return 0;
+}
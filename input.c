@@ -3,38 +3,87 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/time.h>
 #include <linux/input.h>
 #include <linux/kd.h>
 #include <pthread.h>
 #include <dirent.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <string.h>
 
 #include "input.h"
 #include "framebuffer.h"
 #include "util.h"
 #include "log.h"
 
-#define MAX_DEVICES 16
+// events read from a device by one read()
+#define EV_READ_BATCH 64
+// epoll events handled per wake up
+#define EV_WAIT_BATCH 16
+// epoll data of the wake up eventfd, the replay socket and inotify,
+// devices use their index in ev_devs
+#define EV_WAKE_ID ((uint32_t)-1)
+#define EV_REPLAY_ID ((uint32_t)-2)
+#define EV_INOTIFY_ID ((uint32_t)-3)
 
 // for touch calculation
 static const int screen_res[] = { 800, 1280 };
 
-static struct pollfd ev_fds[MAX_DEVICES];
-static unsigned ev_count = 0;
+typedef struct
+{
+    int fd; // -1 for a free slot
+    char name[16];
+    int touch;
+    int switch_xy;
+    // touch ranges of the screen axes, after switch_xy is applied
+    int range_x[2];
+    int range_y[2];
+} input_device;
+
+// devices come and go, free slots are reused and the array grows when
+// there are none
+static input_device *ev_devs = NULL;
+static int ev_devs_size = 0;
+static int ev_inotify = -1;
+static int ev_dir_wd = -1; // /dev/input
+static int ev_dev_wd = -1; // /dev, until /dev/input shows up
+static int ev_epoll = -1;
+static int ev_wake = -1; // eventfd, wakes the thread up to quit or for injected events
 static volatile int input_run = 0;
-
-static int key_queue[10];
-static int8_t key_itr = 10;
-static pthread_mutex_t key_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t latency[INPUT_LATENCY_BUCKETS];
+
+// Released keys, the input thread is the only producer and there is one
+// consumer at a time. The indexes only grow, the ring is full when they
+// are KEY_RING_SIZE apart. The mutex and condvar are only for sleeping in
+// wait_for_key_event(), the ring itself does not need them.
+#define KEY_RING_SIZE 16
+static struct
+{
+    key_event events[KEY_RING_SIZE];
+    volatile uint32_t head; // written by the input thread
+    volatile uint32_t tail; // written by the consumer
+    volatile uint32_t dropped;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} keys = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
 static pthread_mutex_t touch_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_t input_thread;
 
 static touch_event mt_events[10];
 static int mt_slot = 0;
-static int switch_xy = 0;
-static int mt_range_x[2] = { 0 };
-static int mt_range_y[2] = { 0 };
+// motion is dispatched at most once per frame, pending reports are
+// flushed at mt_flush_at, 0 when there are none
+static uint64_t mt_flush_at = 0;
+static struct timeval mt_report_time;
+static uint32_t mt_reports_received;
+static uint32_t mt_reports_dispatched;
 
 struct handler_list_it
 {
@@ -56,6 +105,23 @@ static handler_list_it *mt_handlers = NULL;
 static handlers_ctx **inactive_ctx = NULL;
 static int mt_handlers_mode = HANDLERS_FIRST;
 
+#define INJECT_MAX 32
+// ids of injected touches, so that they don't mix with the real ones
+#define INJECT_ID_BASE 0x10000
+
+typedef struct
+{
+    int key; // -1 for touch
+    int id;
+    int x, y;
+    int pressed;
+} injected_event;
+
+static injected_event inject_queue[INJECT_MAX];
+static int inject_cnt = 0;
+static pthread_mutex_t inject_mutex = PTHREAD_MUTEX_INITIALIZER;
+static touch_event inject_touch[10];
+
 #define DIV_ROUND_UP(n,d)  (((n) + (d) - 1) / (d))
 #define BIT(nr)            (1UL << (nr))
 #define BIT_MASK(nr)       (1UL << ((nr) % BITS_PER_LONG))
@@ -64,106 +130,260 @@ static int mt_handlers_mode = HANDLERS_FIRST;
 #define BITS_PER_LONG      (sizeof(long) * BITS_PER_BYTE)
 #define BITS_TO_LONGS(nr)  DIV_ROUND_UP(nr, BITS_PER_BYTE * sizeof(long))
 
-static void get_abs_min_max(int fd)
+static void ev_get_touch_info(input_device *dev)
 {
+    long absbit[BITS_TO_LONGS(ABS_CNT)];
     int abs[5];
-    if(ioctl(fd, EVIOCGABS(ABS_MT_POSITION_X), abs) >= 0)
-        memcpy(mt_range_x, abs+1, 2*sizeof(int));
 
-    if(ioctl(fd, EVIOCGABS(ABS_MT_POSITION_Y), abs) >= 0)
-        memcpy(mt_range_y, abs+1, 2*sizeof(int));
+    if(ioctl(dev->fd, EVIOCGBIT(EV_ABS, ABS_CNT), absbit) < 0 ||
+        !(absbit[BIT_WORD(ABS_MT_POSITION_X)] & BIT_MASK(ABS_MT_POSITION_X)) ||
+        !(absbit[BIT_WORD(ABS_MT_POSITION_Y)] & BIT_MASK(ABS_MT_POSITION_Y)))
+    {
+        return;
+    }
+
+    if(ioctl(dev->fd, EVIOCGABS(ABS_MT_POSITION_X), abs) < 0)
+        return;
+    memcpy(dev->range_x, abs+1, 2*sizeof(int));
 
+    if(ioctl(dev->fd, EVIOCGABS(ABS_MT_POSITION_Y), abs) < 0)
+        return;
+    memcpy(dev->range_y, abs+1, 2*sizeof(int));
 
-    switch_xy = (mt_range_x[1] > mt_range_y[1]);
-    if(switch_xy)
+    // calc_mt_pos() divides by them
+    if(dev->range_x[0] == dev->range_x[1] || dev->range_y[0] == dev->range_y[1])
+        return;
+
+    dev->switch_xy = (dev->range_x[1] > dev->range_y[1]);
+    if(dev->switch_xy)
     {
-        memcpy(abs, mt_range_x, 2*sizeof(int));
-        memcpy(mt_range_x, mt_range_y, 2*sizeof(int));
-        memcpy(mt_range_y, abs, 2*sizeof(int));
+        memcpy(abs, dev->range_x, 2*sizeof(int));
+        memcpy(dev->range_x, dev->range_y, 2*sizeof(int));
+        memcpy(dev->range_y, abs, 2*sizeof(int));
     }
+    dev->touch = 1;
+}
+
+static void ev_grow_devices(void)
+{
+    int i = ev_devs_size;
+
+    ev_devs_size = ev_devs_size ? ev_devs_size*2 : 8;
+    ev_devs = realloc(ev_devs, ev_devs_size*sizeof(input_device));
+    for(; i < ev_devs_size; ++i)
+        ev_devs[i].fd = -1;
 }
 
-static int ev_init(void)
+static void ev_add_device(const char *name)
+{
+    struct epoll_event epev;
+    input_device *dev;
+    char path[64];
+    int i, fd;
+
+    if(strncmp(name, "event", 5) != 0 || strlen(name) >= sizeof(dev->name))
+        return;
+
+    // the scan and inotify can both report the same device
+    for(i = 0; i < ev_devs_size; ++i)
+        if(ev_devs[i].fd >= 0 && strcmp(ev_devs[i].name, name) == 0)
+            return;
+
+    snprintf(path, sizeof(path), "/dev/input/%s", name);
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        ERROR("input: failed to open %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    for(i = 0; i < ev_devs_size && ev_devs[i].fd >= 0; ++i);
+    if(i == ev_devs_size)
+        ev_grow_devices();
+
+    dev = &ev_devs[i];
+    memset(dev, 0, sizeof(input_device));
+    dev->fd = fd;
+    strcpy(dev->name, name);
+    ev_get_touch_info(dev);
+
+    memset(&epev, 0, sizeof(epev));
+    epev.events = EPOLLIN;
+    epev.data.u32 = i;
+    if(epoll_ctl(ev_epoll, EPOLL_CTL_ADD, fd, &epev) < 0)
+    {
+        ERROR("input: failed to add %s to epoll: %s\n", path, strerror(errno));
+        close(fd);
+        dev->fd = -1;
+        return;
+    }
+
+    INFO("input: added %s%s\n", name, dev->touch ? ", touchscreen" : "");
+}
+
+static void ev_rm_device(int idx)
+{
+    INFO("input: removed %s\n", ev_devs[idx].name);
+    epoll_ctl(ev_epoll, EPOLL_CTL_DEL, ev_devs[idx].fd, NULL);
+    close(ev_devs[idx].fd);
+    ev_devs[idx].fd = -1;
+}
+
+static void ev_scan_dir(void)
 {
     DIR *dir;
     struct dirent *de;
-    int fd;
-    long absbit[BITS_TO_LONGS(ABS_CNT)];
-
-    ev_count = 0;
 
     dir = opendir("/dev/input");
     if(!dir)
-        return -1;
+        return;
 
     while((de = readdir(dir)))
+        ev_add_device(de->d_name);
+    closedir(dir);
+}
+
+// watches /dev/input and opens what is already there, or watches /dev
+// until /dev/input is created, early in the boot
+static void ev_watch_dir(void)
+{
+    ev_dir_wd = inotify_add_watch(ev_inotify, "/dev/input", IN_CREATE | IN_DELETE);
+    if(ev_dir_wd < 0)
     {
-        if(strncmp(de->d_name,"event",5))
-            continue;
+        if(ev_dev_wd < 0)
+            ev_dev_wd = inotify_add_watch(ev_inotify, "/dev", IN_CREATE);
+        return;
+    }
 
-        fd = openat(dirfd(dir), de->d_name, O_RDONLY);
-        if(fd < 0)
-            continue;
+    if(ev_dev_wd >= 0)
+    {
+        inotify_rm_watch(ev_inotify, ev_dev_wd);
+        ev_dev_wd = -1;
+    }
+    ev_scan_dir();
+}
 
-        ev_fds[ev_count].fd = fd;
-        ev_fds[ev_count].events = POLLIN;
+static void ev_handle_inotify(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ie;
+    char *itr;
+    int i, len;
 
-        if (ioctl(fd, EVIOCGBIT(EV_ABS, ABS_CNT), absbit) >= 0)
+    while((len = read(ev_inotify, buf, sizeof(buf))) > 0)
+    {
+        for(itr = buf; itr < buf + len; itr += sizeof(struct inotify_event) + ie->len)
         {
-             if ((absbit[BIT_WORD(ABS_MT_POSITION_X)] & BIT_MASK(ABS_MT_POSITION_X)) &&
-                (absbit[BIT_WORD(ABS_MT_POSITION_Y)] & BIT_MASK(ABS_MT_POSITION_Y)))
-             {
-                 get_abs_min_max(fd);
-             }
+            ie = (struct inotify_event*)itr;
+
+            if(ie->mask & IN_Q_OVERFLOW)
+                ev_scan_dir();
+            else if(ie->wd == ev_dev_wd)
+            {
+                if((ie->mask & IN_CREATE) && ie->len > 0 && strcmp(ie->name, "input") == 0)
+                    ev_watch_dir();
+            }
+            else if(ie->wd == ev_dir_wd)
+            {
+                if(ie->mask & IN_CREATE)
+                    ev_add_device(ie->name);
+                else if(ie->mask & IN_DELETE)
+                {
+                    for(i = 0; i < ev_devs_size; ++i)
+                        if(ev_devs[i].fd >= 0 && strcmp(ev_devs[i].name, ie->name) == 0)
+                            ev_rm_device(i);
+                }
+                else if(ie->mask & IN_IGNORED)
+                {
+                    // /dev/input itself is gone
+                    ev_dir_wd = -1;
+                    ev_watch_dir();
+                }
+            }
         }
+    }
+}
 
-        ev_count++;
-        if(ev_count == MAX_DEVICES) break;
+static void ev_init(void)
+{
+    struct epoll_event epev;
+
+    ev_inotify = inotify_init();
+    if(ev_inotify < 0)
+    {
+        ERROR("input: inotify is not available, only devices present now are used: %s\n", strerror(errno));
+        ev_scan_dir();
+        return;
     }
-    closedir(dir);
+    fcntl(ev_inotify, F_SETFL, O_NONBLOCK);
 
-    return 0;
+    memset(&epev, 0, sizeof(epev));
+    epev.events = EPOLLIN;
+    epev.data.u32 = EV_INOTIFY_ID;
+    epoll_ctl(ev_epoll, EPOLL_CTL_ADD, ev_inotify, &epev);
+
+    ev_watch_dir();
 }
 
 static void ev_exit(void)
 {
-    while (ev_count > 0) {
-        close(ev_fds[--ev_count].fd);
-    }
+    int i;
+
+    for(i = 0; i < ev_devs_size; ++i)
+        if(ev_devs[i].fd >= 0)
+            close(ev_devs[i].fd);
+
+    free(ev_devs);
+    ev_devs = NULL;
+    ev_devs_size = 0;
+
+    if(ev_inotify >= 0)
+        close(ev_inotify);
+    ev_inotify = ev_dir_wd = ev_dev_wd = -1;
 }
 
-static int ev_get(struct input_event *ev, unsigned dont_wait)
+static void record_latency(struct input_event *ev)
 {
-    int r;
-    unsigned n;
+    struct timeval now;
+    int64_t us;
+    int i = 0;
 
-    do {
-        r = poll(ev_fds, ev_count, dont_wait ? 0 : -1);
+    // evdev timestamps use the realtime clock
+    gettimeofday(&now, NULL);
+    us = ((int64_t)(now.tv_sec - ev->time.tv_sec))*1000000 + (now.tv_usec - ev->time.tv_usec);
 
-        if(r > 0) {
-            for(n = 0; n < ev_count; n++) {
-                if(ev_fds[n].revents & POLLIN) {
-                    r = read(ev_fds[n].fd, ev, sizeof(*ev));
-                    if(r == sizeof(*ev)) return 0;
-                }
-            }
-        }
-    } while(dont_wait == 0);
-
-    return -1;
+    while(us > 1 && i < INPUT_LATENCY_BUCKETS-1)
+    {
+        us >>= 1;
+        ++i;
+    }
+    ++latency[i];
 }
 
 #define IS_KEY_HANDLED(key) (key >= KEY_VOLUMEDOWN && key <= KEY_POWER)
 
 static void handle_key_event(struct input_event *ev)
 {
+    uint32_t head = keys.head;
+
     if(ev->value != 0 || !IS_KEY_HANDLED(ev->code))
         return;
 
-    pthread_mutex_lock(&key_mutex);
-    if(key_itr > 0)
-        key_queue[--key_itr] = ev->code;
-    pthread_mutex_unlock(&key_mutex);
+    // the consumer is too slow, keep the keys it has not seen yet
+    if(head - keys.tail >= KEY_RING_SIZE)
+    {
+        ++keys.dropped;
+        return;
+    }
+
+    keys.events[head % KEY_RING_SIZE].code = ev->code;
+    keys.events[head % KEY_RING_SIZE].time = ev->time;
+    __sync_synchronize();
+    keys.head = head + 1;
+
+    pthread_mutex_lock(&keys.lock);
+    pthread_cond_signal(&keys.cond);
+    pthread_mutex_unlock(&keys.lock);
 }
 
 static int calc_mt_pos(int val, int *range, int d_max)
@@ -179,41 +399,78 @@ static inline int64_t get_us_diff(struct timeval now, struct timeval prev)
         (now.tv_usec - prev.tv_usec);
 }
 
-static void handle_touch_event(struct input_event *ev)
+static void dispatch_touch_event(touch_event *ev)
 {
-    // SYN_REPORT, send events to handlers
-    if(ev->type == EV_SYN && ev->code == SYN_REPORT)
+    touch_handler *h;
+    handler_list_it *it = mt_handlers;
+
+    while(it)
     {
-        pthread_mutex_lock(&touch_mutex);
-        int has_handlers = (mt_handlers != NULL);
-        pthread_mutex_unlock(&touch_mutex);
+        h = it->handler;
+        if((*h->callback)(ev, h->data) == 0 && mt_handlers_mode == HANDLERS_FIRST)
+            break;
+        it = it->next;
+    }
+}
 
-        if(!has_handlers)
-            return;
+// sends changes of all slots since the previous flush to handlers, us_diff
+// covers all reports merged into this one
+static void flush_touch_events(void)
+{
+    uint32_t i;
+
+    mt_flush_at = 0;
+
+    pthread_mutex_lock(&touch_mutex);
+    int has_handlers = (mt_handlers != NULL);
+    pthread_mutex_unlock(&touch_mutex);
+
+    if(!has_handlers)
+        return;
+
+    ++mt_reports_dispatched;
+    for(i = 0; i < ARRAY_SIZE(mt_events); ++i)
+    {
+        mt_events[i].us_diff = get_us_diff(mt_report_time, mt_events[i].time);
+        mt_events[i].time = mt_report_time;
 
+        if(!mt_events[i].changed)
+            continue;
+
+        dispatch_touch_event(&mt_events[i]);
+        mt_events[i].changed = 0;
+    }
+}
+
+// live reports with only motion wait for the next frame, anything drawn
+// in between would not be shown anyway. Added and removed touches go out
+// right away, with the motion merged into them.
+static void handle_touch_event(struct input_event *ev, input_device *dev, int live)
+{
+    // SYN_REPORT, send events to handlers
+    if(ev->type == EV_SYN && ev->code == SYN_REPORT)
+    {
         uint32_t i;
-        touch_handler *h;
-        handler_list_it *it;
+        int changed = 0;
 
         for(i = 0; i < ARRAY_SIZE(mt_events); ++i)
-        {
-            mt_events[i].us_diff = get_us_diff(ev->time, mt_events[i].time);
-            mt_events[i].time = ev->time;
+            changed |= mt_events[i].changed;
 
-            if(!mt_events[i].changed)
-                continue;
+        if(!changed)
+            return;
 
-            it = mt_handlers;
-            while(it)
-            {
-                h = it->handler;
-                if((*h->callback)(&mt_events[i], h->data) == 0 && mt_handlers_mode == HANDLERS_FIRST)
-                    break;
-                it = it->next;
-            }
+        ++mt_reports_received;
+        mt_report_time = ev->time;
 
-            mt_events[i].changed = 0;
+        if(live && !(changed & (TCHNG_ADDED | TCHNG_REMOVED)))
+        {
+            if(mt_flush_at == 0)
+                mt_flush_at = fb_next_frame_time();
+            if(gettime_us() < mt_flush_at)
+                return;
         }
+
+        flush_touch_events();
         return;
     }
 
@@ -238,14 +495,17 @@ static void handle_touch_event(struct input_event *ev)
         case ABS_MT_POSITION_X:
         case ABS_MT_POSITION_Y:
         {
-            if((ev->code == ABS_MT_POSITION_X) ^ (switch_xy != 0))
+            if(!dev->touch)
+                break;
+
+            if((ev->code == ABS_MT_POSITION_X) ^ (dev->switch_xy != 0))
             {
-                mt_events[mt_slot].x = calc_mt_pos(ev->value, mt_range_x, screen_res[0]);
-                if(switch_xy)
+                mt_events[mt_slot].x = calc_mt_pos(ev->value, dev->range_x, screen_res[0]);
+                if(dev->switch_xy)
                     mt_events[mt_slot].x = screen_res[0] - mt_events[mt_slot].x;
             }
             else
-                mt_events[mt_slot].y = calc_mt_pos(ev->value, mt_range_y, screen_res[1]);
+                mt_events[mt_slot].y = calc_mt_pos(ev->value, dev->range_y, screen_res[1]);
 
             mt_events[mt_slot].changed |= TCHNG_POS;
             break;
@@ -312,75 +572,703 @@ void set_touch_handlers_mode(int mode)
     mt_handlers_mode = mode;
 }
 
+static void handle_injected_touch(injected_event *inj)
+{
+    touch_event *ev = NULL;
+    struct timeval now;
+    uint32_t i;
+
+    // slot of the touch, or a free one for a new touch
+    for(i = 0; i < ARRAY_SIZE(inject_touch); ++i)
+    {
+        if(inject_touch[i].id == INJECT_ID_BASE + inj->id)
+        {
+            ev = &inject_touch[i];
+            break;
+        }
+        if(!ev && inject_touch[i].id == -1)
+            ev = &inject_touch[i];
+    }
+
+    if(!ev || (ev->id == -1 && !inj->pressed))
+        return;
+
+    gettimeofday(&now, NULL);
+    ev->us_diff = ev->id == -1 ? 0 : get_us_diff(now, ev->time);
+    ev->time = now;
+    ev->changed = TCHNG_POS;
+    if(ev->id == -1)
+        ev->changed |= TCHNG_ADDED;
+    if(!inj->pressed)
+        ev->changed |= TCHNG_REMOVED;
+
+    ev->id = INJECT_ID_BASE + inj->id;
+    ev->x = inj->x;
+    ev->y = inj->y;
+
+    pthread_mutex_lock(&touch_mutex);
+    int has_handlers = (mt_handlers != NULL);
+    pthread_mutex_unlock(&touch_mutex);
+
+    if(has_handlers)
+        dispatch_touch_event(ev);
+
+    ev->changed = 0;
+    if(!inj->pressed)
+        ev->id = -1;
+}
+
+static void handle_injected_events(void)
+{
+    injected_event events[INJECT_MAX];
+    struct input_event key_ev;
+    int i, cnt;
+
+    pthread_mutex_lock(&inject_mutex);
+    cnt = inject_cnt;
+    memcpy(events, inject_queue, cnt*sizeof(injected_event));
+    inject_cnt = 0;
+    pthread_mutex_unlock(&inject_mutex);
+
+    for(i = 0; i < cnt; ++i)
+    {
+        if(events[i].key == -1)
+        {
+            handle_injected_touch(&events[i]);
+            continue;
+        }
+
+        // keys are handled when they are released
+        memset(&key_ev, 0, sizeof(key_ev));
+        gettimeofday(&key_ev.time, NULL);
+        key_ev.type = EV_KEY;
+        key_ev.code = events[i].key;
+        key_ev.value = 0;
+        handle_key_event(&key_ev);
+    }
+}
+
+static void inject_event(injected_event *ev)
+{
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&inject_mutex);
+    if(inject_cnt < INJECT_MAX)
+        inject_queue[inject_cnt++] = *ev;
+    else
+        ERROR("input: too many injected events, dropping one\n");
+    pthread_mutex_unlock(&inject_mutex);
+
+    if(ev_wake >= 0)
+        write(ev_wake, &one, sizeof(one));
+}
+
+void input_inject_key(int code)
+{
+    injected_event ev = { .key = code };
+    inject_event(&ev);
+}
+
+void input_inject_touch(int id, int x, int y, int pressed)
+{
+    injected_event ev = { .key = -1, .id = id, .x = x, .y = y, .pressed = pressed };
+    inject_event(&ev);
+}
+
+static struct
+{
+    pthread_mutex_t lock;
+    FILE *f;
+    struct timeval last;
+    uint32_t count;
+    input_device dev; // touch ranges of the header
+} rec = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    pthread_cond_t stop_cond; // cuts the realtime waits
+    volatile int run;
+    int active;
+    int done;  // the input thread has seen the end
+    int fd[2]; // fd[0] is read by the input thread like a device
+    FILE *f;
+    int realtime;
+    input_device dev; // the recording device
+    int count;
+} replay = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+    .stop_cond = PTHREAD_COND_INITIALIZER,
+    .fd = { -1, -1 },
+};
+
+#define IS_POS_EVENT(ev) ((ev)->type == EV_ABS && \
+    ((ev)->code == ABS_MT_POSITION_X || (ev)->code == ABS_MT_POSITION_Y))
+
+// maps a position event of one device to the same screen position on another
+static void convert_pos(struct input_event *ev, input_device *from, input_device *to)
+{
+    int *r_from, *r_to, screen_x;
+
+    // the same as in handle_touch_event()
+    screen_x = (ev->code == ABS_MT_POSITION_X) ^ (from->switch_xy != 0);
+    r_from = screen_x ? from->range_x : from->range_y;
+    r_to = screen_x ? to->range_x : to->range_y;
+
+    // rounded, truncating would often move the position one percent lower
+    // in calc_mt_pos()
+    if(r_from[0] != r_to[0] || r_from[1] != r_to[1])
+    {
+        ev->value = r_to[0] + ((int64_t)(ev->value - r_from[0])*(r_to[1] - r_to[0])*2 +
+            (r_from[1] - r_from[0]))/((r_from[1] - r_from[0])*2);
+    }
+    ev->code = (screen_x ^ (to->switch_xy != 0)) ? ABS_MT_POSITION_X : ABS_MT_POSITION_Y;
+}
+
+static void record_write_header(FILE *f, input_device *dev)
+{
+    input_rec_header hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = INPUT_REC_MAGIC;
+    hdr.version = INPUT_REC_VERSION;
+    memcpy(hdr.range_x, dev->range_x, sizeof(hdr.range_x));
+    memcpy(hdr.range_y, dev->range_y, sizeof(hdr.range_y));
+    hdr.switch_xy = dev->switch_xy;
+    fwrite(&hdr, sizeof(hdr), 1, f);
+}
+
+static void record_event(struct input_event *ev, input_device *dev)
+{
+    struct input_event pos;
+    input_rec_event e;
+    int64_t dt;
+
+    pthread_mutex_lock(&rec.lock);
+    if(rec.f)
+    {
+        if(IS_POS_EVENT(ev) && dev->touch)
+        {
+            // the first touchscreen sets the ranges of the recording
+            if(!rec.dev.touch)
+            {
+                rec.dev = *dev;
+                fseek(rec.f, 0, SEEK_SET);
+                record_write_header(rec.f, &rec.dev);
+                fseek(rec.f, 0, SEEK_END);
+            }
+
+            pos = *ev;
+            convert_pos(&pos, dev, &rec.dev);
+            ev = &pos;
+        }
+
+        dt = rec.count > 0 ? get_us_diff(ev->time, rec.last) : 0;
+        e.dt_us = dt < 0 ? 0 : (dt > UINT32_MAX ? UINT32_MAX : dt);
+        e.type = ev->type;
+        e.code = ev->code;
+        e.value = ev->value;
+        fwrite(&e, sizeof(e), 1, rec.f);
+
+        rec.last = ev->time;
+        ++rec.count;
+    }
+    pthread_mutex_unlock(&rec.lock);
+}
+
+// live events come from the devices, replayed ones are not recorded again
+static void handle_event(struct input_event *ev, input_device *dev, int live)
+{
+    if(live && rec.f)
+        record_event(ev, dev);
+
+    switch(ev->type)
+    {
+        case EV_KEY:
+            handle_key_event(ev);
+            if(live)
+                record_latency(ev);
+            break;
+        case EV_ABS:
+            handle_touch_event(ev, dev, live);
+            break;
+        case EV_SYN:
+            handle_touch_event(ev, dev, live);
+            if(live && ev->code == SYN_REPORT)
+                record_latency(ev);
+            break;
+    }
+}
+
+// reads everything the device has, many events at once, returns -1 when
+// the device is gone
+static int read_device(input_device *dev, int live)
+{
+    struct input_event evs[EV_READ_BATCH];
+    int i, r;
+
+    while((r = read(dev->fd, evs, sizeof(evs))) > 0)
+    {
+        for(i = 0; i < r/(int)sizeof(struct input_event); ++i)
+            handle_event(&evs[i], dev, live);
+
+        if(r < (int)sizeof(evs))
+            return 0;
+    }
+    return (r < 0 && (errno == EAGAIN || errno == EINTR)) ? 0 : -1;
+}
+
+// the input thread has read everything or is quitting
+static void replay_finish(void)
+{
+    epoll_ctl(ev_epoll, EPOLL_CTL_DEL, replay.fd[0], NULL);
+    close(replay.fd[0]);
+
+    pthread_mutex_lock(&replay.lock);
+    replay.fd[0] = -1;
+    replay.done = 1;
+    pthread_cond_broadcast(&replay.done_cond);
+    pthread_mutex_unlock(&replay.lock);
+}
+
 static void *input_thread_work(void *cookie)
 {
-    ev_init();
-    struct input_event ev;
+    struct epoll_event events[EV_WAIT_BATCH];
+    uint64_t val, now;
+    uint32_t idx;
+    int i, cnt, timeout;
 
     memset(mt_events, 0, sizeof(mt_events));
+    memset(inject_touch, 0, sizeof(inject_touch));
+    memset(latency, 0, sizeof(latency));
 
-    key_itr = 10;
+    for(i = 0; i < (int)ARRAY_SIZE(inject_touch); ++i)
+        inject_touch[i].id = -1;
+
+    // keys from the previous run are stale
+    keys.tail = keys.head;
     mt_slot = 0;
+    mt_flush_at = 0;
+    mt_reports_received = mt_reports_dispatched = 0;
+
+    ev_init();
 
-    int res;
     while(input_run)
     {
-        while(ev_get(&ev, 1) == 0)
+        // sleeps until a device or ev_wake has something, or until the
+        // pending touch motion is due
+        timeout = -1;
+        if(mt_flush_at != 0)
         {
-            switch(ev.type)
+            now = gettime_us();
+            timeout = now < mt_flush_at ? (int)DIV_ROUND_UP(mt_flush_at - now, 1000) : 0;
+        }
+
+        cnt = epoll_wait(ev_epoll, events, ARRAY_SIZE(events), timeout);
+        wakeup_count();
+
+        for(i = 0; i < cnt; ++i)
+        {
+            idx = events[i].data.u32;
+            if(idx == EV_WAKE_ID)
+                read(ev_wake, &val, sizeof(val));
+            else if(idx == EV_REPLAY_ID)
             {
-                case EV_KEY:
-                    handle_key_event(&ev);
-                    break;
-                case EV_ABS:
-                case EV_SYN:
-                    handle_touch_event(&ev);
-                    break;
+                if(read_device(&replay.dev, 0) < 0)
+                    replay_finish();
+            }
+            else if(idx == EV_INOTIFY_ID)
+                ev_handle_inotify();
+            // it may have been removed by inotify in this round
+            else if(idx < (uint32_t)ev_devs_size && ev_devs[idx].fd >= 0 &&
+                read_device(&ev_devs[idx], 1) < 0)
+            {
+                // it would keep waking the thread up
+                ev_rm_device(idx);
             }
         }
-        usleep(10000);
+        handle_injected_events();
+
+        if(mt_flush_at != 0 && gettime_us() >= mt_flush_at)
+            flush_touch_events();
     }
+
+    if(replay.fd[0] >= 0)
+        replay_finish();
     ev_exit();
-    pthread_exit(NULL);
     return NULL;
 }
 
+static int key_ring_pop(key_event *ev)
+{
+    uint32_t tail = keys.tail;
+
+    if(tail == keys.head)
+        return -1;
+
+    __sync_synchronize();
+    *ev = keys.events[tail % KEY_RING_SIZE];
+    __sync_synchronize();
+    keys.tail = tail + 1;
+    return 0;
+}
+
 int get_last_key(void)
 {
-    int res = -1;
-    pthread_mutex_lock(&key_mutex);
-    if(key_itr != 10)
-        res = key_queue[key_itr++];
-    pthread_mutex_unlock(&key_mutex);
-    return res;
+    key_event ev;
+    return key_ring_pop(&ev) == 0 ? ev.code : -1;
 }
 
 int wait_for_key(void)
 {
-    int res = -1;
-    while(res == -1)
+    key_event ev;
+    wait_for_key_event(&ev, -1);
+    return ev.code;
+}
+
+int wait_for_key_event(key_event *ev, int timeout_ms)
+{
+    struct timeval tv;
+    struct timespec ts;
+    uint64_t abs;
+    int res;
+
+    if(key_ring_pop(ev) == 0)
+        return 0;
+
+    if(timeout_ms >= 0)
     {
-        res = get_last_key();
-        usleep(10000);
+        // cond waits use the realtime clock
+        gettimeofday(&tv, NULL);
+        abs = (uint64_t)tv.tv_sec*1000000 + tv.tv_usec + (uint64_t)timeout_ms*1000;
+        ts.tv_sec = abs/1000000;
+        ts.tv_nsec = (abs%1000000)*1000;
     }
+
+    pthread_mutex_lock(&keys.lock);
+    while((res = key_ring_pop(ev)) != 0)
+    {
+        if(timeout_ms < 0)
+            pthread_cond_wait(&keys.cond, &keys.lock);
+        else if(pthread_cond_timedwait(&keys.cond, &keys.lock, &ts) == ETIMEDOUT)
+        {
+            res = key_ring_pop(ev);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&keys.lock);
     return res;
 }
 
+uint32_t input_keys_dropped(void)
+{
+    return keys.dropped;
+}
+
 void start_input_thread(void)
 {
+    struct epoll_event epev;
+
     if(input_run)
         return;
 
+    ev_wake = eventfd(0, 0);
+    ev_epoll = epoll_create(EV_WAIT_BATCH);
+    if(ev_wake < 0 || ev_epoll < 0)
+    {
+        ERROR("input: failed to create eventfd or epoll: %s\n", strerror(errno));
+        close(ev_wake);
+        close(ev_epoll);
+        ev_wake = ev_epoll = -1;
+        return;
+    }
+
+    memset(&epev, 0, sizeof(epev));
+    epev.events = EPOLLIN;
+    epev.data.u32 = EV_WAKE_ID;
+    epoll_ctl(ev_epoll, EPOLL_CTL_ADD, ev_wake, &epev);
+
     input_run = 1;
     pthread_create(&input_thread, NULL, input_thread_work, NULL);
 }
 
 void stop_input_thread(void)
 {
+    uint64_t one = 1;
+
     if(!input_run)
         return;
+
     input_run = 0;
+    write(ev_wake, &one, sizeof(one));
     pthread_join(input_thread, NULL);
+
+    input_replay_stop();
+    if(rec.f)
+        input_record_stop();
+
+    close(ev_wake);
+    close(ev_epoll);
+    ev_wake = ev_epoll = -1;
+
+    input_log_latency();
+    if(keys.dropped)
+        INFO("input: %u keys dropped, the queue was full\n", keys.dropped);
+    if(mt_reports_received)
+        INFO("input: %u touch reports, %u dispatched\n", mt_reports_received, mt_reports_dispatched);
+}
+
+void input_get_touch_stats(uint32_t *received, uint32_t *dispatched)
+{
+    *received = mt_reports_received;
+    *dispatched = mt_reports_dispatched;
+}
+
+void input_get_latency(uint32_t *buckets)
+{
+    memcpy(buckets, latency, sizeof(latency));
+}
+
+void input_log_latency(void)
+{
+    uint32_t total = 0, sum = 0;
+    int i, p50 = -1, p99 = -1;
+
+    for(i = 0; i < INPUT_LATENCY_BUCKETS; ++i)
+        total += latency[i];
+
+    if(total == 0)
+        return;
+
+    for(i = 0; i < INPUT_LATENCY_BUCKETS; ++i)
+    {
+        sum += latency[i];
+        if(p50 == -1 && sum*2 >= total)
+            p50 = i;
+        if(p99 == -1 && sum*100 >= total*99)
+            p99 = i;
+    }
+
+    // upper bounds of the buckets
+    INFO("input: %u events, latency p50 < %u us, p99 < %u us\n", total, 2u << p50, 2u << p99);
+}
+
+int input_record_start(const char *path)
+{
+    input_device no_touch;
+    FILE *f;
+
+    f = fopen(path, "w");
+    if(!f)
+    {
+        ERROR("input: failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // the ranges are filled in by the first touch
+    memset(&no_touch, 0, sizeof(no_touch));
+    record_write_header(f, &no_touch);
+
+    pthread_mutex_lock(&rec.lock);
+    if(rec.f)
+        fclose(rec.f);
+    rec.f = f;
+    rec.count = 0;
+    rec.dev = no_touch;
+    pthread_mutex_unlock(&rec.lock);
+    return 0;
+}
+
+int input_record_stop(void)
+{
+    int res = -1;
+
+    pthread_mutex_lock(&rec.lock);
+    if(rec.f)
+    {
+        res = (fclose(rec.f) == 0) ? (int)rec.count : -1;
+        rec.f = NULL;
+    }
+    pthread_mutex_unlock(&rec.lock);
+    return res;
+}
+
+// sleeps until the monotonic time due, or until input_replay_stop()
+static void replay_wait_until(uint64_t due)
+{
+    struct timeval tv;
+    struct timespec ts;
+    uint64_t now, abs;
+
+    pthread_mutex_lock(&replay.lock);
+    while(replay.run && (now = gettime_us()) < due)
+    {
+        gettimeofday(&tv, NULL);
+        abs = (uint64_t)tv.tv_sec*1000000 + tv.tv_usec + (due - now);
+        ts.tv_sec = abs/1000000;
+        ts.tv_nsec = (abs%1000000)*1000;
+        pthread_cond_timedwait(&replay.stop_cond, &replay.lock, &ts);
+    }
+    pthread_mutex_unlock(&replay.lock);
+}
+
+static void *replay_thread_work(void *data)
+{
+    struct input_event evs[EV_READ_BATCH];
+    struct timeval base;
+    input_rec_event e;
+    uint64_t start, due = 0;
+    int cnt = 0;
+
+    // timestamps follow the recording even when it goes faster, so that
+    // handlers which look at them behave the same way
+    gettimeofday(&base, NULL);
+    start = gettime_us();
+
+    while(replay.run && fread(&e, sizeof(e), 1, replay.f) == 1)
+    {
+        due += e.dt_us;
+
+        // send what is queued before waiting for the next event
+        if(cnt == EV_READ_BATCH || (cnt > 0 && replay.realtime && e.dt_us > 0))
+        {
+            if(send(replay.fd[1], evs, cnt*sizeof(struct input_event), MSG_NOSIGNAL) < 0)
+                break;
+            cnt = 0;
+        }
+
+        if(replay.realtime)
+        {
+            replay_wait_until(start + due);
+            if(!replay.run)
+                break;
+        }
+
+        memset(&evs[cnt], 0, sizeof(struct input_event));
+        evs[cnt].time.tv_sec = base.tv_sec + (base.tv_usec + due)/1000000;
+        evs[cnt].time.tv_usec = (base.tv_usec + due)%1000000;
+        evs[cnt].type = e.type;
+        evs[cnt].code = e.code;
+        evs[cnt].value = e.value;
+        ++cnt;
+        ++replay.count;
+    }
+
+    if(cnt > 0)
+        send(replay.fd[1], evs, cnt*sizeof(struct input_event), MSG_NOSIGNAL);
+
+    // the input thread sees the end of the replay
+    close(replay.fd[1]);
+    replay.fd[1] = -1;
+    return NULL;
+}
+
+int input_replay_start(const char *path, int realtime)
+{
+    struct epoll_event epev;
+    input_rec_header hdr;
+
+    if(!input_run || replay.active)
+    {
+        ERROR("input: can't replay %s, %s\n", path, replay.active ? "another replay is running" : "the input thread is not running");
+        return -1;
+    }
+
+    replay.f = fopen(path, "r");
+    if(!replay.f)
+    {
+        ERROR("input: failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if(fread(&hdr, sizeof(hdr), 1, replay.f) != 1 ||
+        hdr.magic != INPUT_REC_MAGIC || hdr.version != INPUT_REC_VERSION)
+    {
+        ERROR("input: %s is not an input recording\n", path);
+        goto fail;
+    }
+
+    // packets keep the events whole, the same as reads from evdev
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, replay.fd) < 0)
+    {
+        ERROR("input: failed to create replay socket: %s\n", strerror(errno));
+        goto fail;
+    }
+    fcntl(replay.fd[0], F_SETFL, O_NONBLOCK);
+
+    // positions are read with the ranges of the recording device, so they
+    // land where they did, whatever touchscreen this device has
+    memset(&replay.dev, 0, sizeof(replay.dev));
+    strcpy(replay.dev.name, "replay");
+    replay.dev.fd = replay.fd[0];
+    replay.dev.touch = (hdr.range_x[0] != hdr.range_x[1] && hdr.range_y[0] != hdr.range_y[1]);
+    replay.dev.switch_xy = hdr.switch_xy;
+    memcpy(replay.dev.range_x, hdr.range_x, sizeof(replay.dev.range_x));
+    memcpy(replay.dev.range_y, hdr.range_y, sizeof(replay.dev.range_y));
+
+    replay.done = 0;
+    replay.count = 0;
+    replay.realtime = realtime;
+    replay.run = 1;
+
+    memset(&epev, 0, sizeof(epev));
+    epev.events = EPOLLIN;
+    epev.data.u32 = EV_REPLAY_ID;
+    if(epoll_ctl(ev_epoll, EPOLL_CTL_ADD, replay.fd[0], &epev) < 0 ||
+        pthread_create(&replay.thread, NULL, replay_thread_work, NULL) != 0)
+    {
+        ERROR("input: failed to start the replay\n");
+        epoll_ctl(ev_epoll, EPOLL_CTL_DEL, replay.fd[0], NULL);
+        close(replay.fd[0]);
+        close(replay.fd[1]);
+        replay.fd[0] = replay.fd[1] = -1;
+        goto fail;
+    }
+
+    replay.active = 1;
+    return 0;
+
+fail:
+    fclose(replay.f);
+    replay.f = NULL;
+    return -1;
+}
+
+int input_replay_wait(void)
+{
+    if(!replay.active)
+        return -1;
+
+    pthread_mutex_lock(&replay.lock);
+    while(!replay.done)
+        pthread_cond_wait(&replay.done_cond, &replay.lock);
+    pthread_mutex_unlock(&replay.lock);
+
+    // the input thread can quit before the replay thread has sent everything
+    replay.run = 0;
+    pthread_join(replay.thread, NULL);
+
+    fclose(replay.f);
+    replay.f = NULL;
+    replay.active = 0;
+    return replay.count;
+}
+
+void input_replay_stop(void)
+{
+    if(!replay.active)
+        return;
+
+    pthread_mutex_lock(&replay.lock);
+    replay.run = 0;
+    pthread_cond_broadcast(&replay.stop_cond);
+    pthread_mutex_unlock(&replay.lock);
+    input_replay_wait();
 }
 
 void input_push_context(void)
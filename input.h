@@ -2,6 +2,7 @@
 #define INPUT_H
 
 #include <sys/time.h>
+#include <stdint.h>
 
 #define KEY_VOLUMEUP 115
 #define KEY_VOLUMEDOWN 114
@@ -39,16 +40,86 @@ typedef struct
     touch_callback callback;
 } touch_handler;
 
+// The input thread watches /dev/input, devices can be plugged in and
+// removed while it runs.
 void start_input_thread(void);
 void stop_input_thread(void);
 
+typedef struct
+{
+    int code;
+    struct timeval time; // of the release, from the kernel
+} key_event;
+
+// Keys are queued when they are released and read oldest first, only one
+// thread may read them at a time.
+// returns -1 when there is no key
 int get_last_key(void);
 int wait_for_key(void);
+// waits up to timeout_ms, or forever with -1, returns 0 with the key in ev or -1
+int wait_for_key_event(key_event *ev, int timeout_ms);
+// keys lost because the queue was full
+uint32_t input_keys_dropped(void);
 
 void add_touch_handler(touch_callback callback, void *data);
 void rm_touch_handler(touch_callback callback, void *data);
 void set_touch_handlers_mode(int mode);
 
+// Events which don't come from the input devices, e.g. from the remote
+// framebuffer server. The input thread handles them like the real ones,
+// x and y are in screen coordinates.
+void input_inject_key(int code);
+void input_inject_touch(int id, int x, int y, int pressed);
+
+// Time from the kernel timestamp of an event to its dispatch, for keys and
+// touch reports. Bucket i counts events which took 2^i to 2^(i+1) us, the
+// first one also everything faster and the last one everything slower.
+#define INPUT_LATENCY_BUCKETS 24
+void input_get_latency(uint32_t *buckets);
+// logs the count and p50/p99 of the latency, the input thread does it when it stops
+void input_log_latency(void);
+// Touch reports with changes read from the devices, and how many times
+// handlers were called for them. Motion is merged up to the next frame,
+// replayed reports are all dispatched.
+void input_get_touch_stats(uint32_t *received, uint32_t *dispatched);
+
+// Recordings start with input_rec_header, then there is one
+// input_rec_event per event, all little endian.
+#define INPUT_REC_MAGIC 0x5249524D // "MRIR"
+#define INPUT_REC_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    // touch ranges of the first touchscreen in the recording, after
+    // switch_xy is applied, positions from others are converted to them
+    int32_t range_x[2];
+    int32_t range_y[2];
+    int32_t switch_xy;
+} input_rec_header; // only 32-bit fields, no padding
+
+typedef struct
+{
+    uint32_t dt_us; // since the previous event
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+} __attribute__((packed)) input_rec_event;
+
+// Records the events of all devices into a file, touch positions are kept
+// in the ranges of the first touchscreen. Returns the event count on stop.
+int input_record_start(const char *path);
+int input_record_stop(void);
+// Feeds a recording to the running input thread, either with the original
+// timing or as fast as the handlers take it. Event timestamps follow the
+// recording in both cases and touch positions are read with the recorded
+// ranges, so a session replays the same way, even without a touchscreen.
+// wait returns the count of replayed events.
+int input_replay_start(const char *path, int realtime);
+int input_replay_wait(void);
+void input_replay_stop(void);
+
 void input_push_context(void);
 void input_pop_context(void);
 
@@ -0,0 +1,27 @@
+#ifndef ISO_FONT_SCALED_H
+#define ISO_FONT_SCALED_H
+
+#include <stdint.h>
+
+// Rows of iso_font expanded for each text size up to FONT_SCALE_MAX: bit b
+// of a font row becomes size bits starting at b*size, so bit n of the
+// mask is pixel n of the scaled row. The compiler generates the tables
+// from the macros below, there is nothing to regenerate by hand.
+#define FONT_SCALE_MAX 4
+
+#define FONT_BIT(v, b, s) ((((v) >> (b)) & 1) ? ((1u << (s)) - 1) << ((b)*(s)) : 0u)
+#define FONT_ROW(v, s) (FONT_BIT(v, 0, s) | FONT_BIT(v, 1, s) | FONT_BIT(v, 2, s) | FONT_BIT(v, 3, s) | \
+                        FONT_BIT(v, 4, s) | FONT_BIT(v, 5, s) | FONT_BIT(v, 6, s) | FONT_BIT(v, 7, s))
+#define FONT_ROW4(v, s)   FONT_ROW(v, s), FONT_ROW(v+1, s), FONT_ROW(v+2, s), FONT_ROW(v+3, s)
+#define FONT_ROW16(v, s)  FONT_ROW4(v, s), FONT_ROW4(v+4, s), FONT_ROW4(v+8, s), FONT_ROW4(v+12, s)
+#define FONT_ROW64(v, s)  FONT_ROW16(v, s), FONT_ROW16(v+16, s), FONT_ROW16(v+32, s), FONT_ROW16(v+48, s)
+#define FONT_ROW256(s)    FONT_ROW64(0, s), FONT_ROW64(64, s), FONT_ROW64(128, s), FONT_ROW64(192, s)
+
+static const uint32_t iso_font_scaled[FONT_SCALE_MAX][256] = {
+    { FONT_ROW256(1) },
+    { FONT_ROW256(2) },
+    { FONT_ROW256(3) },
+    { FONT_ROW256(4) },
+};
+
+#endif
@@ -15,10 +15,18 @@
 
 void listview_init_ui(listview *view)
 {
-    int x = view->x + view->w - PADDING/2 - LINE_W/2;
+    int x = view->w - PADDING/2 - LINE_W/2;
 
-    fb_rect *scroll_line = fb_add_rect(x, view->y, LINE_W, view->h, GRAYISH);
-    list_add(scroll_line, &view->ui_items);
+    view->ui = widget_create(NULL, view->x, view->y);
+    widget_add_rect(view->ui, x, 0, LINE_W, view->h, GRAYISH);
+
+    view->clip.x = view->x;
+    view->clip.y = view->y;
+    view->clip.w = view->w - PADDING;
+    view->clip.h = view->h;
+
+    view->rows = widget_create(view->ui, 0, 0);
+    widget_set_clip(view->rows, &view->clip);
 
     view->touch.id = -1;
     view->touch.last_y = -1;
@@ -30,10 +38,9 @@ void listview_destroy(listview *view)
 {
     rm_touch_handler(&listview_touch_handler, view);
 
+    // items destroy their own widgets, do that before the rest of the tree
     listview_clear(view);
-    list_clear(&view->ui_items, &fb_remove_item);
-
-    fb_rm_rect(view->scroll_mark);
+    widget_destroy(view->ui);
 
     free(view);
 }
@@ -66,12 +73,13 @@ void listview_update_ui(listview *view)
         it = view->items[i];
         it_h = (*view->item_height)(it->data);
 
-        visible = (int)(view->pos <= y && y+it_h-view->pos <= view->h);
+        // partially visible items are clipped to the view
+        visible = (int)(y+it_h > view->pos && y-view->pos < view->h);
 
         if(!visible && (it->flags & IT_VISIBLE))
             (*view->item_hide)(it->data);
         else if(visible)
-            (*view->item_draw)(view->x, view->y+y-view->pos, view->w - PADDING, it);
+            (*view->item_draw)(view->rows, 0, y-view->pos, view->w - PADDING, it);
 
         if(visible)
             it->flags |= IT_VISIBLE;
@@ -97,12 +105,12 @@ void listview_enable_scroll(listview *view, int enable)
 
     if(enable)
     {
-        int x = view->x + view->w - PADDING/2 - MARK_W/2;
-        view->scroll_mark = fb_add_rect(x, view->y, MARK_W, MARK_H, GRAYISH);
+        int x = view->w - PADDING/2 - MARK_W/2;
+        view->scroll_mark = widget_add_rect(view->ui, x, 0, MARK_W, MARK_H, GRAYISH);
     }
     else
     {
-        fb_rm_rect(view->scroll_mark);
+        widget_rm_item(view->ui, view->scroll_mark);
         view->scroll_mark = NULL;
     }
 }
@@ -113,8 +121,9 @@ void listview_update_scroll_mark(listview *view)
         return;
 
     int pct = (view->pos*100)/(view->fullH-view->h);
-    int y = view->y + ((view->h - MARK_H)*pct)/100;
-    view->scroll_mark->head.y = y;
+    int x = view->w - PADDING/2 - MARK_W/2;
+    int y = ((view->h - MARK_H)*pct)/100;
+    widget_move_item(view->ui, view->scroll_mark, x, y);
 }
 
 int listview_touch_handler(touch_event *ev, void *data)
@@ -194,34 +203,38 @@ void listview_select_item(listview *view, listview_item *it)
     view->selected = it;
 }
 
-void listview_scroll_by(listview *view, int y)
+// moves pixels of the items instead of drawing them again, only the
+// newly visible part is drawn
+static void listview_scroll_pos(listview *view, int pos)
 {
-    if(!view->scroll_mark)
-        return;
+    if(pos < 0)
+        pos = 0;
+    else if(pos > (view->fullH - view->h))
+        pos = (view->fullH - view->h);
 
-    view->pos += y;
+    if(pos == view->pos)
+        return;
 
-    if(view->pos < 0)
-        view->pos = 0;
-    else if(view->pos > (view->fullH - view->h))
-        view->pos = (view->fullH - view->h);
+    fb_scroll(view->clip.x, view->clip.y, view->clip.w, view->clip.h, view->pos - pos);
+    view->pos = pos;
 
     listview_update_ui(view);
 }
 
-void listview_scroll_to(listview *view, int pct)
+void listview_scroll_by(listview *view, int y)
 {
     if(!view->scroll_mark)
         return;
 
-    view->pos = ((view->fullH - view->h)*pct)/100;
+    listview_scroll_pos(view, view->pos + y);
+}
 
-    if(view->pos < 0)
-        view->pos = 0;
-    else if(view->pos > (view->fullH - view->h))
-        view->pos = (view->fullH - view->h);
+void listview_scroll_to(listview *view, int pct)
+{
+    if(!view->scroll_mark)
+        return;
 
-    listview_update_ui(view);
+    listview_scroll_pos(view, ((view->fullH - view->h)*pct)/100);
 }
 
 listview_item *listview_item_at(listview *view, int y_pos)
@@ -244,19 +257,19 @@ listview_item *listview_item_at(listview *view, int y_pos)
 }
 
 #define ROM_ITEM_H 100
+#define ROM_ICON_SIZE 64
 
 typedef struct
 {
     char *text;
     char *partition;
-    fb_text *text_it;
-    fb_text *part_it;
-    fb_rect *bottom_line;
+    char *icon;
+    widget *ui;
     fb_rect *hover_rect;
     checkbox *box;
 } rom_item_data;
 
-void *rom_item_create(const char *text, const char *partition)
+void *rom_item_create(const char *text, const char *partition, const char *icon)
 {
     rom_item_data *data = malloc(sizeof(rom_item_data));
     memset(data, 0, sizeof(rom_item_data));
@@ -264,60 +277,66 @@ void *rom_item_create(const char *text, const char *partition)
     data->text = strdup(text);
     if(partition)
         data->partition = strdup(partition);
+    if(icon)
+        data->icon = strdup(icon);
     return data;
 }
 
-void rom_item_draw(int x, int y, int w, listview_item *it)
+void rom_item_draw(widget *parent, int x, int y, int w, listview_item *it)
 {
     rom_item_data *d = (rom_item_data*)it->data;
-    if(!d->text_it)
+    if(!d->ui)
     {
-        d->text_it = fb_add_text(x+100, 0, WHITE, SIZE_BIG, d->text);
-        d->bottom_line = fb_add_rect(x, 0, w, 1, 0xFF1B1B1B);
-        d->box = checkbox_create(0, 0, NULL);
+        int text_x = 100;
+        int text_y = center_y(0, ROM_ITEM_H, SIZE_BIG);
+        fb_image *icon = NULL;
+
+        d->ui = widget_create(parent, x, y);
+
+        // images are cached, this decodes the icon only the first time
+        if(d->icon)
+        {
+            icon = widget_add_image(d->ui, text_x, ROM_ITEM_H/2 - ROM_ICON_SIZE/2,
+                                    ROM_ICON_SIZE, ROM_ICON_SIZE, d->icon);
+        }
+        if(icon)
+            text_x += ROM_ICON_SIZE + 20;
+
+        widget_add_text(d->ui, text_x, text_y, WHITE, SIZE_BIG, d->text);
+        widget_add_rect(d->ui, 0, ROM_ITEM_H-2, w, 1, 0xFF1B1B1B);
+        d->box = checkbox_create(d->ui, 30, ROM_ITEM_H/2 - CHECKBOX_SIZE/2, NULL);
 
         if(d->partition)
-            d->part_it = fb_add_text(x+100, 0, GRAY, SIZE_SMALL, d->partition);
+            widget_add_text(d->ui, text_x, text_y + SIZE_BIG*16 + 2, GRAY, SIZE_SMALL, d->partition);
     }
 
-    d->text_it->head.y = center_y(y, ROM_ITEM_H, SIZE_BIG);
-    d->bottom_line->head.y = y+ROM_ITEM_H-2;
-
-    if(d->part_it)
-        d->part_it->head.y = d->text_it->head.y + SIZE_BIG*16 + 2;
+    widget_move(d->ui, x, y);
 
     if(it->flags & IT_HOVER)
     {
         if(!d->hover_rect)
-            d->hover_rect = fb_add_rect(x, 0, w, rom_item_height(it->data), CLR_SECONDARY);
-        d->hover_rect->head.y = y;
+            d->hover_rect = widget_add_rect(d->ui, 0, 0, w, rom_item_height(it->data), CLR_SECONDARY);
     }
     else if(d->hover_rect)
     {
-        fb_rm_rect(d->hover_rect);
+        widget_rm_item(d->ui, d->hover_rect);
         d->hover_rect = NULL;
     }
 
-    checkbox_set_pos(d->box, x+30, y + (ROM_ITEM_H/2 - 30/2));
     checkbox_select(d->box, (it->flags & IT_SELECTED));
 }
 
 void rom_item_hide(void *data)
 {
     rom_item_data *d = (rom_item_data*)data;
-    if(!d->text_it)
+    if(!d->ui)
         return;
 
-    fb_rm_text(d->text_it);
-    fb_rm_text(d->part_it);
-    fb_rm_rect(d->bottom_line);
-    fb_rm_rect(d->hover_rect);
-
+    // removes the box's widget from d->ui too
     checkbox_destroy(d->box);
+    widget_destroy(d->ui);
 
-    d->text_it = NULL;
-    d->part_it = NULL;
-    d->bottom_line = NULL;
+    d->ui = NULL;
     d->hover_rect = NULL;
     d->box = NULL;
 }
@@ -333,6 +352,7 @@ void rom_item_destroy(listview_item *it)
     rom_item_data *d = (rom_item_data*)it->data;
     free(d->text);
     free(d->partition);
+    free(d->icon);
     free(it->data);
     free(it);
 }
@@ -3,6 +3,7 @@
 
 #include "input.h"
 #include "framebuffer.h"
+#include "widget.h"
 
 enum
 {
@@ -34,17 +35,20 @@ typedef struct
 
     int pos; // scroll pos
     int fullH; // height of all items
+    fb_bbox clip; // area of the items, their fb items are clipped to it
 
     listview_item **items;
     listview_item *selected;
 
-    void (*item_draw)(int, int, int, listview_item *); // x, y, w, item
+    // x and y are relative to parent, which clips the items to the view
+    void (*item_draw)(widget *, int, int, int, listview_item *); // parent, x, y, w, item
     void (*item_hide)(void*); // data
     int (*item_height)(void*); // data
     void (*item_destroy)(listview_item *);
     void (*item_selected)(listview_item *, listview_item *); // prev, now
 
-    fb_item_header **ui_items;
+    widget *ui;
+    widget *rows; // child of ui, parent of the items
     fb_rect *scroll_mark;
 
     listview_touch_data touch;
@@ -64,8 +68,8 @@ void listview_scroll_to(listview *view, int pct);
 listview_item *listview_item_at(listview *view, int y_pos);
 inline void listview_select_item(listview *view, listview_item *it);
 
-void *rom_item_create(const char *text, const char *partition);
-void rom_item_draw(int x, int y, int w, listview_item *it);
+void *rom_item_create(const char *text, const char *partition, const char *icon);
+void rom_item_draw(widget *parent, int x, int y, int w, listview_item *it);
 void rom_item_hide(void *data);
 int rom_item_height(void *data);
 void rom_item_destroy(listview_item *it);
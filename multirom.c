@@ -1,5 +1,6 @@
 #include <sys/stat.h> 
 #include <fcntl.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <dirent.h>
@@ -10,15 +11,19 @@
 #include <sys/mount.h>
 #include <sys/klog.h>
 #include <linux/loop.h>
+#include <sys/inotify.h>
+#include <sys/poll.h>
 
 #include "multirom.h"
 #include "multirom_ui.h"
 #include "framebuffer.h"
+#include "fb_timing.h"
 #include "input.h"
 #include "log.h"
 #include "util.h"
 #include "version.h"
 #include "adb.h"
+#include "screenshot.h"
 
 #define REALDATA "/realdata"
 #define BUSYBOX_BIN "busybox"
@@ -44,6 +49,7 @@ static char ntfs_path[64] = { 0 };
 
 static volatile int run_usb_refresh = 0;
 static pthread_t usb_refresh_thread;
+static int usb_refresh_pipe[2] = { -1, -1 }; // wakes the thread up to quit
 static pthread_mutex_t parts_mutex = PTHREAD_MUTEX_INITIALIZER;
 static void (*usb_refresh_handler)(void) = NULL;
 
@@ -165,6 +171,8 @@ int multirom_init_fb(void)
 {
     vt_set_mode(1);
 
+    fb_set_render_threads(sysconf(_SC_NPROCESSORS_CONF));
+
     if(fb_open() < 0)
     {
         ERROR("Failed to open framebuffer!");
@@ -205,6 +213,7 @@ void multirom_emergency_reboot(void)
     fb_add_text_long(0, 395, GRAYISH, SIZE_SMALL, ++tail);
 
     fb_draw();
+    fb_flush();
     fb_clear();
     fb_close();
 
@@ -281,6 +290,7 @@ int multirom_default_status(struct multirom_status *s)
     s->colors = 0;
     s->brightness = 40;
     s->enable_adb = 0;
+    s->record_input = 0;
 
     char roms_path[256];
     sprintf(roms_path, "%s/roms/"INTERNAL_ROM_NAME, multirom_dir);
@@ -416,6 +426,8 @@ int multirom_load_status(struct multirom_status *s)
             s->brightness = atoi(arg);
         else if(strstr(name, "enable_adb"))
             s->enable_adb = atoi(arg);
+        else if(strstr(name, "record_input"))
+            s->record_input = atoi(arg);
     }
 
     fclose(f);
@@ -482,6 +494,7 @@ int multirom_save_status(struct multirom_status *s)
     fprintf(f, "colors=%d\n", s->colors);
     fprintf(f, "brightness=%d\n", s->brightness);
     fprintf(f, "enable_adb=%d\n", s->enable_adb);
+    fprintf(f, "record_input=%d\n", s->record_input);
 
     fclose(f);
     return 0;
@@ -719,6 +732,7 @@ void multirom_dump_status(struct multirom_status *s)
     fb_debug("  colors=%d\n", s->colors);
     fb_debug("  brightness=%d\n", s->brightness);
     fb_debug("  enable_adb=%d\n", s->enable_adb);
+    fb_debug("  record_input=%d\n", s->record_input);
     fb_debug("  auto_boot_seconds=%d\n", s->auto_boot_seconds);
     fb_debug("  auto_boot_rom=%s\n", s->auto_boot_rom ? s->auto_boot_rom->name : "NULL");
     fb_debug("  curr_rom_part=%s\n", s->curr_rom_part ? s->curr_rom_part : "NULL");
@@ -1002,35 +1016,16 @@ int multirom_get_api_level(const char *path)
 
 void multirom_take_screenshot(void)
 {
-    char *buffer = NULL;
-    int len = fb_clone(&buffer);
-
-    int counter;
-    char path[256];
-    struct stat info;
-    FILE *f = NULL;
-
-    for(counter = 0; 1; ++counter)
-    {
-        sprintf(path, "%s/screenshot_%02d.raw", multirom_dir, counter);
-        if(stat(path, &info) >= 0)
-            continue;
-
-        f = fopen(path, "w");
-        if(f)
-        {
-            fwrite(buffer, 1, len, f);
-            fclose(f);
-        }
-        break;
-    }
-
-    free(buffer);
+    screenshot_take(multirom_dir);
+}
 
-    fb_fill(WHITE);
-    fb_update();
-    usleep(100000);
-    fb_draw();
+// the session can be replayed on the host, see host/mrom_host -r
+void multirom_record_input(void)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/input.mrir", multirom_dir);
+    if(input_record_start(path) >= 0)
+        INFO("Recording input to %s\n", path);
 }
 
 int multirom_get_trampoline_ver(void)
@@ -1789,34 +1784,82 @@ int multirom_mount_usb(struct usb_partition *part)
     return 0;
 }
 
+// ms
+#define USB_REFRESH_POLL 500
+#define USB_REFRESH_SETTLE 300
+
 void *multirom_usb_refresh_thread_work(void *status)
 {
-    uint32_t timer = 0;
+    struct pollfd fds[2];
     struct stat info;
+    char buf[512];
+    int timeout = -1;
+    int changed = 1;
 
     // stat.st_ctime is defined as unsigned long instead
     // of time_t in android
     unsigned long last_change = 0;
 
+    // the thread sleeps until something changes in /dev/block, it polls
+    // the dir only when inotify does not work
+    fds[0].fd = inotify_init();
+    if(fds[0].fd < 0 || inotify_add_watch(fds[0].fd, "/dev/block", IN_CREATE | IN_DELETE) < 0)
+    {
+        ERROR("Failed to watch /dev/block, polling it: %s\n", strerror(errno));
+        if(fds[0].fd >= 0)
+            close(fds[0].fd);
+        fds[0].fd = -1;
+        timeout = USB_REFRESH_POLL;
+    }
+    else
+        fcntl(fds[0].fd, F_SETFL, O_NONBLOCK);
+
+    fds[0].events = POLLIN;
+    fds[1].fd = usb_refresh_pipe[0];
+    fds[1].events = POLLIN;
+
+    // without the pipe, it has to check run_usb_refresh now and then
+    if(fds[1].fd < 0)
+        timeout = USB_REFRESH_POLL;
+
+    if(stat("/dev/block", &info) >= 0)
+        last_change = info.st_ctime;
+
     while(run_usb_refresh)
     {
-        if(timer <= 50)
+        if(changed)
         {
-            if(stat("/dev/block", &info) >= 0 && info.st_ctime > last_change)
-            {
-                multirom_update_partitions((struct multirom_status*)status);
+            multirom_update_partitions((struct multirom_status*)status);
 
-                if(usb_refresh_handler)
-                    (*usb_refresh_handler)();
+            if(usb_refresh_handler)
+                (*usb_refresh_handler)();
+        }
 
-                last_change = info.st_ctime;
-            }
-            timer = 500;
+        if(poll(fds, 2, timeout) < 0 && errno != EINTR)
+            break;
+        wakeup_count();
+
+        if(fds[1].revents)
+            break;
+
+        if(fds[0].revents & POLLIN)
+        {
+            // partitions of a new device appear one by one, take them all at once
+            poll(&fds[1], 1, USB_REFRESH_SETTLE);
+            while(read(fds[0].fd, buf, sizeof(buf)) > 0);
+            changed = 1;
+        }
+        else if(timeout != -1 && stat("/dev/block", &info) >= 0)
+        {
+            changed = (info.st_ctime > last_change);
+            last_change = info.st_ctime;
         }
         else
-            timer -= 50;
-        usleep(50000);
+            changed = 0;
     }
+
+    if(fds[0].fd >= 0)
+        close(fds[0].fd);
     return NULL;
 }
 
@@ -1827,9 +1870,21 @@ void multirom_set_usb_refresh_thread(struct multirom_status *s, int run)
 
     run_usb_refresh = run;
     if(run)
+    {
+        if(pipe(usb_refresh_pipe) < 0)
+            usb_refresh_pipe[0] = usb_refresh_pipe[1] = -1;
         pthread_create(&usb_refresh_thread, NULL, multirom_usb_refresh_thread_work, s);
+    }
     else
+    {
+        if(usb_refresh_pipe[1] >= 0)
+            write(usb_refresh_pipe[1], "q", 1);
         pthread_join(usb_refresh_thread, NULL);
+
+        close(usb_refresh_pipe[0]);
+        close(usb_refresh_pipe[1]);
+        usb_refresh_pipe[0] = usb_refresh_pipe[1] = -1;
+    }
 }
 
 void multirom_set_usb_refresh_handler(void (*handler)(void))
@@ -74,6 +74,7 @@ struct multirom_status
     int colors;
     int brightness;
     int enable_adb;
+    int record_input;
     struct multirom_rom *auto_boot_rom;
     struct multirom_rom *current_rom;
     struct multirom_rom **roms;
@@ -106,6 +107,7 @@ int multirom_create_media_link(void);
 int multirom_get_api_level(const char *path);
 int multirom_get_rom_type(struct multirom_rom *rom);
 void multirom_take_screenshot(void);
+void multirom_record_input(void);
 int multirom_get_trampoline_ver(void);
 int multirom_has_kexec(void);
 int multirom_load_kexec(struct multirom_status *s, struct multirom_rom *rom);
@@ -17,6 +17,8 @@
 #include "version.h"
 #include "pong.h"
 #include "progressdots.h"
+#include "screenshot.h"
+#include "fb_remote.h"
 
 #define HEADER_HEIGHT 75
 #define TAB_BTN_WIDTH 165
@@ -34,6 +36,8 @@ static volatile int loop_act = 0;
 static button *pong_btn = NULL;
 
 static pthread_mutex_t exit_code_mutex = PTHREAD_MUTEX_INITIALIZER;
+// signaled when exit_ui_code or loop_act changes, the UI loop sleeps on it
+static pthread_cond_t loop_cond = PTHREAD_COND_INITIALIZER;
 
 uint32_t CLR_PRIMARY = LBLUE;
 uint32_t CLR_SECONDARY = LBLUE2;
@@ -93,6 +97,15 @@ int multirom_ui(struct multirom_status *s, struct multirom_rom **to_boot)
     add_touch_handler(&multirom_ui_touch_handler, NULL);
     start_input_thread();
 
+    if(s->record_input)
+        multirom_record_input();
+
+#ifdef MR_FB_REMOTE
+    // only reachable over adb forward
+    if(s->enable_adb)
+        fb_remote_start(FB_REMOTE_PORT);
+#endif
+
     multirom_set_brightness(s->brightness);
 
     fb_freeze(0);
@@ -102,9 +115,15 @@ int multirom_ui(struct multirom_status *s, struct multirom_rom **to_boot)
     else
         fb_draw();
 
+    wakeup_rate();
+
     while(1)
     {
         pthread_mutex_lock(&exit_code_mutex);
+        while(exit_ui_code == -1 && !loop_act)
+            pthread_cond_wait(&loop_cond, &exit_code_mutex);
+        wakeup_count();
+
         if(exit_ui_code != -1)
         {
             pthread_mutex_unlock(&exit_code_mutex);
@@ -151,10 +170,10 @@ int multirom_ui(struct multirom_status *s, struct multirom_rom **to_boot)
         }
 
         pthread_mutex_unlock(&exit_code_mutex);
-
-        usleep(100000);
     }
 
+    INFO("ui: %d wakeups per second\n", wakeup_rate());
+
     rm_touch_handler(&multirom_ui_touch_handler, NULL);
 
     fb_create_msgbox(500, 250, CLR_PRIMARY);
@@ -189,10 +208,14 @@ int multirom_ui(struct multirom_status *s, struct multirom_rom **to_boot)
         tab_btns[i] = NULL;
     }
 
+#ifdef MR_FB_REMOTE
+    fb_remote_stop();
+#endif
     stop_input_thread();
 
     multirom_ui_destroy_tab(selected_tab);
     fb_clear();
+    screenshot_flush();
     fb_close();
 
     return exit_ui_code;
@@ -320,13 +343,18 @@ void multirom_ui_switch(int tab)
     fb_draw();
 }
 
+// icon shown next to the ROM's name, in its folder
+static const char *rom_icon_names[] = { "icon.raw", "icon.qoi", NULL };
+
 void multirom_ui_fill_rom_list(listview *view, int mask)
 {
-    int i;
+    int i, x;
     struct multirom_rom *rom;
     void *data;
     listview_item *it;
     char part_desc[64];
+    char icon[256];
+    char *icon_p;
     for(i = 0; mrom_status->roms && mrom_status->roms[i]; ++i)
     {
         rom = mrom_status->roms[i];
@@ -337,7 +365,18 @@ void multirom_ui_fill_rom_list(listview *view, int mask)
         if(rom->partition)
             sprintf(part_desc, "%s (%s)", rom->partition->name, rom->partition->fs);
 
-        data = rom_item_create(rom->name, rom->partition ? part_desc : NULL);
+        icon_p = NULL;
+        for(x = 0; rom->base_path && rom_icon_names[x]; ++x)
+        {
+            snprintf(icon, sizeof(icon), "%s/%s", rom->base_path, rom_icon_names[x]);
+            if(access(icon, R_OK) >= 0)
+            {
+                icon_p = icon;
+                break;
+            }
+        }
+
+        data = rom_item_create(rom->name, rom->partition ? part_desc : NULL, icon_p);
         it = listview_add_item(view, rom->id, data);
 
         if ((mrom_status->auto_boot_rom && rom == mrom_status->auto_boot_rom) ||
@@ -419,7 +458,9 @@ void multirom_ui_auto_boot(void)
         }
         else if((seconds+50)/1000 != seconds/1000)
         {
-            sprintf(sec_text->text, "%d", seconds/1000);
+            char buff[16];
+            snprintf(buff, sizeof(buff), "%d", seconds/1000);
+            fb_text_set(sec_text, buff);
             fb_freeze(0);
             fb_draw();
             fb_freeze(1);
@@ -433,6 +474,7 @@ void multirom_ui_refresh_usb_handler(void)
 {
     pthread_mutex_lock(&exit_code_mutex);
     loop_act |= LOOP_UPDATE_USB;
+    pthread_cond_signal(&loop_cond);
     pthread_mutex_unlock(&exit_code_mutex);
 }
 
@@ -440,6 +482,7 @@ void multirom_ui_start_pong(int action)
 {
     pthread_mutex_lock(&exit_code_mutex);
     loop_act |= LOOP_START_PONG;
+    pthread_cond_signal(&loop_cond);
     pthread_mutex_unlock(&exit_code_mutex);
 }
 
@@ -557,9 +600,7 @@ void multirom_ui_tab_rom_selected(listview_item *prev, listview_item *now)
 
     tab_roms *t = (tab_roms*)tab_data;
 
-    free(t->rom_name->text);
-    t->rom_name->text = malloc(strlen(rom->name)+1);
-    strcpy(t->rom_name->text, rom->name);
+    fb_text_set(t->rom_name, rom->name);
 
     t->rom_name->head.x = center_x(0, fb_width-BOOTBTN_W-20, SIZE_NORMAL, rom->name);
 
@@ -628,6 +669,7 @@ void multirom_ui_tab_rom_boot_btn(int action)
     pthread_mutex_lock(&exit_code_mutex);
     selected_rom = rom;
     exit_ui_code = UI_EXIT_BOOT_ROM;
+    pthread_cond_signal(&loop_cond);
     pthread_mutex_unlock(&exit_code_mutex);
 }
 
@@ -636,8 +678,7 @@ void multirom_ui_tab_rom_update_usb(void *data)
     tab_roms *t = (tab_roms*)tab_data;
     listview_clear(t->list);
 
-    t->rom_name->text = realloc(t->rom_name->text, 1);
-    t->rom_name->text[0] = 0;
+    fb_text_set(t->rom_name, "");
 
     multirom_ui_fill_rom_list(t->list, MASK_USB_ROMS);
     listview_update_ui(t->list);
@@ -658,8 +699,7 @@ void multirom_ui_tab_rom_set_empty(void *data, int empty)
 
     static const char *str[] = { "Select ROM to boot:", "No ROMs in this location!" };
     t->title_text->head.x = center_x(0, fb_width, SIZE_BIG, str[empty]);
-    t->title_text->text = realloc(t->title_text->text, strlen(str[empty])+1);
-    strcpy(t->title_text->text, str[empty]);
+    fb_text_set(t->title_text, str[empty]);
 
     if(t->boot_btn)
         button_enable(t->boot_btn, !empty);
@@ -811,6 +851,7 @@ void multirom_ui_tab_misc_change_clr(int clr)
     pthread_mutex_lock(&exit_code_mutex);
     mrom_status->colors = clr;
     loop_act |= LOOP_CHANGE_CLR;
+    pthread_cond_signal(&loop_cond);
     pthread_mutex_unlock(&exit_code_mutex);
 }
 
@@ -818,6 +859,7 @@ void multirom_ui_reboot_btn(int action)
 {
     pthread_mutex_lock(&exit_code_mutex);
     exit_ui_code = action;
+    pthread_cond_signal(&loop_cond);
     pthread_mutex_unlock(&exit_code_mutex);
 }
 
@@ -27,6 +27,8 @@
 #define COMPUTER_SPEED 10
 
 static fb_text *score[2] = { NULL, NULL };
+// fb_text_set() shows the new text only after next frame, don't parse it back
+static int score_val[2] = { 0, 0 };
 static fb_rect *paddles[2] = { NULL, NULL };
 static fb_rect *ball = NULL;
 static int paddle_last_x[2] = { -1, -1 };
@@ -66,6 +68,7 @@ void pong(void)
     // middle line
     fb_add_rect(0, fb_height/2 - 1, fb_width, 1, WHITE);
 
+    score_val[L] = score_val[R] = 0;
     score[L] = fb_add_text(0, fb_height/2 - SIZE_EXTRA*16 - 20, WHITE, SIZE_EXTRA, "0");
     score[R] = fb_add_text(0, fb_height/2 + 20, WHITE, SIZE_EXTRA, "0");
 
@@ -265,11 +268,8 @@ int pong_get_collision(int x, int y)
 void pong_add_score(int side)
 {
     char buff[16];
-    int curr = atoi(score[side]->text);
-
-    sprintf(buff, "%d", ++curr);
-    score[side]->text = realloc(score[side]->text, strlen(buff)+1);
-    strcpy(score[side]->text, buff);
+    sprintf(buff, "%d", ++score_val[side]);
+    fb_text_set(score[side], buff);
 }
 
 void pong_handle_ai(void)
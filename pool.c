@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "log.h"
+
+// Every object has this header in front of it. Indexes are +1, so that
+// zero ends the free list. 8 bytes keep the objects 8-byte aligned.
+typedef struct
+{
+    uint32_t index;
+    uint32_t next; // of the next free object
+} pool_hdr;
+
+static inline size_t pool_stride(pool *p)
+{
+    return (sizeof(pool_hdr) + p->item_size + 7) & ~(size_t)7;
+}
+
+// slab k starts at object slab_items*(2^k - 1)
+static inline uint32_t pool_slab_first(pool *p, int k)
+{
+    return p->slab_items*((1u << k) - 1);
+}
+
+// idx is +1, the slab of the index is already published
+static inline pool_hdr *pool_hdr_at(pool *p, uint32_t idx)
+{
+    int k = 31 - __builtin_clz((idx - 1)/p->slab_items + 1);
+    return (pool_hdr*)((char*)p->slabs[k] + (idx - 1 - pool_slab_first(p, k))*pool_stride(p));
+}
+
+// puts the chain of free objects from first to last to the front of the list
+static void pool_push(pool *p, pool_hdr *first, pool_hdr *last)
+{
+    uint64_t head;
+    do
+    {
+        head = p->free_head;
+        last->next = (uint32_t)head;
+    }
+    while(!__sync_bool_compare_and_swap(&p->free_head, head,
+        (((head >> 32) + 1) << 32) | first->index));
+}
+
+// puts all objects of a new slab to the free list
+static int pool_grow(pool *p)
+{
+    size_t stride = pool_stride(p);
+    uint32_t i, n, first;
+    pool_hdr *h;
+    char *slab;
+    int k, res = 0;
+
+    pthread_mutex_lock(&p->lock);
+
+    // somebody else has grown it or freed an object meanwhile
+    if((uint32_t)p->free_head != 0)
+        goto exit;
+
+    k = p->slab_count;
+    if(k == POOL_MAX_SLABS)
+    {
+        ERROR("pool: all %d slabs of %u byte objects are used\n", POOL_MAX_SLABS, (unsigned)p->item_size);
+        res = -1;
+        goto exit;
+    }
+
+    n = p->slab_items << k;
+    first = pool_slab_first(p, k);
+    slab = malloc(n*stride);
+    if(!slab)
+    {
+        res = -1;
+        goto exit;
+    }
+
+    for(i = 0; i < n; ++i)
+    {
+        h = (pool_hdr*)(slab + i*stride);
+        h->index = first + i + 1;
+        h->next = first + i + 2;
+    }
+
+    // the slab must be visible before any of its indexes is
+    p->slabs[k] = slab;
+    ++p->heap_allocs;
+    __sync_synchronize();
+    p->slab_count = k + 1;
+
+    pool_push(p, (pool_hdr*)slab, (pool_hdr*)(slab + (n - 1)*stride));
+
+exit:
+    pthread_mutex_unlock(&p->lock);
+    return res;
+}
+
+// returns zeroed object or NULL
+void *pool_alloc(pool *p)
+{
+    uint64_t head;
+    pool_hdr *h;
+
+    for(;;)
+    {
+        head = p->free_head;
+        if((uint32_t)head == 0)
+        {
+            if(pool_grow(p) < 0)
+                return NULL;
+            continue;
+        }
+
+        // h->next can be stale when another thread took h meanwhile, the
+        // counter in the head has moved on then and the swap fails. Slabs
+        // are never freed, so reading it is safe.
+        h = pool_hdr_at(p, (uint32_t)head);
+        if(__sync_bool_compare_and_swap(&p->free_head, head,
+            (((head >> 32) + 1) << 32) | h->next))
+        {
+            break;
+        }
+    }
+
+    __sync_fetch_and_add(&p->allocs, 1);
+    memset(h + 1, 0, p->item_size);
+    return h + 1;
+}
+
+void pool_free(pool *p, void *obj)
+{
+    pool_hdr *h;
+    if(!obj)
+        return;
+
+    h = (pool_hdr*)obj - 1;
+    pool_push(p, h, h);
+}
+
+// all objects from the pool must not be used anymore
+void pool_destroy(pool *p)
+{
+    int i;
+
+    pthread_mutex_lock(&p->lock);
+    for(i = 0; i < p->slab_count; ++i)
+    {
+        free(p->slabs[i]);
+        p->slabs[i] = NULL;
+    }
+    p->slab_count = 0;
+    p->free_head = 0;
+    pthread_mutex_unlock(&p->lock);
+}
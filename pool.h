@@ -0,0 +1,39 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Allocator for many objects of the same size. Objects are carved from
+// slabs, the first one has slab_items of them and each next one twice as
+// many. Freed objects are put on a free list and reused, slabs are
+// returned to the heap only by pool_destroy().
+//
+// pool_alloc() and pool_free() are lock-free. The free list head holds
+// the index of the first free object and a counter bumped on every
+// change, so that a thread which read the head before others popped and
+// pushed the same object back fails its compare-and-swap. lock is taken
+// only to add a slab.
+#define POOL_MAX_SLABS 24
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t item_size;
+    int slab_items;
+    volatile uint64_t free_head; // counter << 32 | index+1 of the first free object
+    void *slabs[POOL_MAX_SLABS];
+    volatile int slab_count;
+    volatile uint32_t allocs; // objects handed out
+    uint32_t heap_allocs;     // slabs taken from the heap
+} pool;
+
+#define POOL_INITIALIZER(type, count) \
+    { PTHREAD_MUTEX_INITIALIZER, sizeof(type), (count), 0, { NULL }, 0, 0, 0 }
+
+void *pool_alloc(pool *p);
+void pool_free(pool *p, void *obj);
+void pool_destroy(pool *p);
+
+#endif
@@ -1,33 +1,22 @@
 #include <unistd.h>
 #include "progressdots.h"
 #include "multirom_ui.h"
+#include "timers.h"
 
 // ms
 #define SWITCH_SPEED 800
-#define THREAD_SLEEP 50
 
-static void *progdots_thread(void *data)
+static int progdots_switch(void *data)
 {
     progdots *p = (progdots*)data;
-    int timer = SWITCH_SPEED;
 
-    while(p->run)
-    {
-        if(timer <= THREAD_SLEEP)
-        {
-            if(++p->active_dot >= PROGDOTS_CNT)
-                p->active_dot = 0;
-
-            progdots_set_active(p, p->active_dot); 
-            fb_draw();
+    if(++p->active_dot >= PROGDOTS_CNT)
+        p->active_dot = 0;
 
-            timer = SWITCH_SPEED;
-        }
-        else timer -= THREAD_SLEEP;
-
-        usleep(THREAD_SLEEP*1000);
-    }
-    return NULL;
+    // only the two changed dots are drawn again
+    progdots_set_active(p, p->active_dot);
+    fb_draw();
+    return 1;
 }
 
 progdots *progdots_create(int x, int y)
@@ -36,27 +25,25 @@ progdots *progdots_create(int x, int y)
     memset(p, 0, sizeof(progdots));
     p->x = x;
     p->y = y;
-    p->run = 1;
+    p->ui = widget_create(NULL, x, y);
 
+    x = 0;
     int i;
     for(i = 0; i < PROGDOTS_CNT; ++i)
     {
-        p->dots[i] = fb_add_rect(x, y, PROGDOTS_H, PROGDOTS_H, (i == 0 ? CLR_PRIMARY : WHITE));
+        p->dots[i] = widget_add_rect(p->ui, x, 0, PROGDOTS_H, PROGDOTS_H, (i == 0 ? CLR_PRIMARY : WHITE));
         x += PROGDOTS_H + (PROGDOTS_W - (PROGDOTS_CNT*PROGDOTS_H))/(PROGDOTS_CNT-1);
     }
-    pthread_create(&p->thread, NULL, progdots_thread, p);
+    timer_add(SWITCH_SPEED, progdots_switch, p);
     fb_draw();
     return p;
 }
 
 void progdots_destroy(progdots *p)
 {
-    p->run = 0;
-    pthread_join(p->thread, NULL);
+    timer_rm(progdots_switch, p);
 
-    int i;
-    for(i = 0; i < PROGDOTS_CNT; ++i)
-        fb_rm_rect(p->dots[i]);
+    widget_destroy(p->ui);
     free(p);
 }
 
@@ -1,8 +1,8 @@
 #ifndef PROGRESSDOTS_H
 #define PROGRESSDOTS_H
 
-#include <pthread.h>
 #include "framebuffer.h"
+#include "widget.h"
 
 #define PROGDOTS_W 300
 #define PROGDOTS_H 10
@@ -11,8 +11,7 @@
 typedef struct
 {
     int x, y;
-    pthread_t thread;
-    volatile int run;
+    widget *ui;
     fb_rect *dots[PROGDOTS_CNT];
     int active_dot;
 } progdots;
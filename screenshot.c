@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "screenshot.h"
+#include "framebuffer.h"
+#include "fb_format.h"
+#include "fb_timing.h"
+#include "util.h"
+#include "log.h"
+
+// the white flash after taking a screenshot
+#define FLASH_MS 100
+// every queued screenshot holds a copy of the frame
+#define MAX_PENDING 2
+#define WRITE_BUFFER (64*1024)
+
+typedef struct screenshot_job
+{
+    struct screenshot_job *next;
+    char *dir;
+    char *frame;
+    int format;
+    int w, h;
+    int stride;
+} screenshot_job;
+
+static struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;
+    int quit;
+    int pending;
+    screenshot_job *first;
+    screenshot_job *last;
+    int counter; // next free screenshot number, -1 until the dir is scanned
+    uint64_t flash_end;
+} writer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .counter = -1,
+};
+
+// QOI chunks of one line are collected in buf and written at once
+typedef struct
+{
+    uint8_t *buf;
+    int len;
+    uint8_t index[64][4];
+    uint8_t prev[4];
+    int run;
+} qoi_encoder;
+
+static inline void qoi_put(qoi_encoder *e, uint8_t val)
+{
+    e->buf[e->len++] = val;
+}
+
+static void qoi_put32(qoi_encoder *e, uint32_t val)
+{
+    qoi_put(e, val >> 24);
+    qoi_put(e, val >> 16);
+    qoi_put(e, val >> 8);
+    qoi_put(e, val);
+}
+
+static void qoi_flush_run(qoi_encoder *e)
+{
+    if(e->run > 0)
+    {
+        qoi_put(e, 0xC0 | (e->run - 1));
+        e->run = 0;
+    }
+}
+
+// px is r, g, b, a
+static inline void qoi_pixel(qoi_encoder *e, const uint8_t *px)
+{
+    int hash, dr, dg, db, dr_dg, db_dg;
+
+    if(memcmp(px, e->prev, 4) == 0)
+    {
+        if(++e->run == 62)
+            qoi_flush_run(e);
+        return;
+    }
+    qoi_flush_run(e);
+
+    hash = (px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) % 64;
+    if(memcmp(e->index[hash], px, 4) == 0)
+        qoi_put(e, hash);
+    else
+    {
+        memcpy(e->index[hash], px, 4);
+
+        dr = (int8_t)(px[0] - e->prev[0]);
+        dg = (int8_t)(px[1] - e->prev[1]);
+        db = (int8_t)(px[2] - e->prev[2]);
+        dr_dg = dr - dg;
+        db_dg = db - dg;
+
+        if(px[3] != e->prev[3])
+        {
+            qoi_put(e, 0xFF);
+            memcpy(e->buf + e->len, px, 4);
+            e->len += 4;
+        }
+        else if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+            qoi_put(e, 0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+        else if(dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+        {
+            qoi_put(e, 0x80 | (dg + 32));
+            qoi_put(e, ((dr_dg + 8) << 4) | (db_dg + 8));
+        }
+        else
+        {
+            qoi_put(e, 0xFE);
+            memcpy(e->buf + e->len, px, 3);
+            e->len += 3;
+        }
+    }
+    memcpy(e->prev, px, 4);
+}
+
+// encodes the frame line by line straight into the file
+static int screenshot_encode(screenshot_job *job, FILE *f)
+{
+    static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    const fb_format *fmt = fb_format_get(job->format);
+    qoi_encoder e;
+    uint8_t *line;
+    uint8_t px[4];
+    uint32_t color;
+    int x, y;
+
+    memset(&e, 0, sizeof(e));
+    // worst case is 5 bytes per pixel, plus header and padding
+    e.buf = malloc(job->w*5 + 32);
+    e.prev[3] = 0xFF;
+
+    memcpy(e.buf, "qoif", 4);
+    e.len = 4;
+    qoi_put32(&e, job->w);
+    qoi_put32(&e, job->h);
+    qoi_put(&e, 3); // RGB
+    qoi_put(&e, 0); // sRGB
+
+    for(y = 0; y < job->h; ++y)
+    {
+        line = (uint8_t*)job->frame + y*job->stride;
+        for(x = 0; x < job->w; ++x)
+        {
+            if(fmt->bpp == 4)
+                color = (*fmt->to_color)(((uint32_t*)line)[x]);
+            else
+                color = (*fmt->to_color)(((uint16_t*)line)[x]);
+
+            px[0] = color;
+            px[1] = color >> 8;
+            px[2] = color >> 16;
+            px[3] = 0xFF; // the top byte of the framebuffer is padding
+            qoi_pixel(&e, px);
+        }
+
+        if(y == job->h - 1)
+        {
+            qoi_flush_run(&e);
+            memcpy(e.buf + e.len, padding, sizeof(padding));
+            e.len += sizeof(padding);
+        }
+
+        fwrite(e.buf, 1, e.len, f);
+        e.len = 0;
+    }
+
+    free(e.buf);
+    return ferror(f) ? -1 : 0;
+}
+
+// highest number of existing screenshot + 1, so that none are overwritten
+static int screenshot_scan_dir(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *dt;
+    int n, res = 0;
+
+    if(!d)
+        return 0;
+
+    while((dt = readdir(d)))
+    {
+        if(sscanf(dt->d_name, "screenshot_%d.", &n) == 1 && n >= res)
+            res = n + 1;
+    }
+    closedir(d);
+    return res;
+}
+
+static void screenshot_write(screenshot_job *job)
+{
+    char path[256];
+    char tmp[256+4];
+    char *buf;
+    FILE *f;
+    int res;
+
+    if(writer.counter < 0)
+        writer.counter = screenshot_scan_dir(job->dir);
+
+    snprintf(path, sizeof(path), "%s/screenshot_%02d.qoi", job->dir, writer.counter++);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    f = fopen(tmp, "w");
+    if(!f)
+    {
+        ERROR("screenshot: failed to open %s: %s\n", tmp, strerror(errno));
+        return;
+    }
+
+    buf = malloc(WRITE_BUFFER);
+    setvbuf(f, buf, _IOFBF, WRITE_BUFFER);
+
+    res = screenshot_encode(job, f);
+    if(fclose(f) != 0)
+        res = -1;
+    free(buf);
+
+    // half-written files never show up under the final name
+    if(res < 0 || rename(tmp, path) < 0)
+    {
+        ERROR("screenshot: failed to write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+
+    INFO("screenshot: saved %s\n", path);
+
+#ifdef MR_FB_TIMING
+    snprintf(path, sizeof(path), "%s/fb_timing.txt", job->dir);
+    fb_timing_dump(path);
+#endif
+}
+
+static void *screenshot_thread_work(void *data)
+{
+    screenshot_job *job;
+
+    pthread_mutex_lock(&writer.lock);
+    while(1)
+    {
+        while(!writer.first && !writer.quit)
+            pthread_cond_wait(&writer.cond, &writer.lock);
+
+        if(!writer.first)
+            break;
+
+        job = writer.first;
+        writer.first = job->next;
+        if(!writer.first)
+            writer.last = NULL;
+        pthread_mutex_unlock(&writer.lock);
+
+        // end the flash first, the screen is redrawn from scratch
+        usleep(FLASH_MS*1000);
+        fb_draw();
+
+        screenshot_write(job);
+        free(job->frame);
+        free(job->dir);
+        free(job);
+
+        pthread_mutex_lock(&writer.lock);
+        --writer.pending;
+    }
+    pthread_mutex_unlock(&writer.lock);
+    return NULL;
+}
+
+int screenshot_take(const char *dir)
+{
+    screenshot_job *job;
+
+    pthread_mutex_lock(&writer.lock);
+    if(writer.pending >= MAX_PENDING)
+    {
+        pthread_mutex_unlock(&writer.lock);
+        ERROR("screenshot: %d screenshots are still being written, skipping\n", MAX_PENDING);
+        return -1;
+    }
+    ++writer.pending;
+    pthread_mutex_unlock(&writer.lock);
+
+    // fb_fill() damaged whole screen, this draws the scene over the flash
+    if(gettime_us() < writer.flash_end)
+        fb_draw();
+
+    job = malloc(sizeof(screenshot_job));
+    memset(job, 0, sizeof(screenshot_job));
+    job->dir = strdup(dir);
+    fb_clone(&job->frame);
+    job->format = fb_get_format();
+    job->w = fb_width;
+    job->h = fb_height;
+    job->stride = fb->fi.line_length;
+
+    pthread_mutex_lock(&writer.lock);
+    if(writer.last)
+        writer.last->next = job;
+    else
+        writer.first = job;
+    writer.last = job;
+
+    if(!writer.running)
+    {
+        writer.quit = 0;
+        writer.running = (pthread_create(&writer.thread, NULL, screenshot_thread_work, NULL) == 0);
+        if(!writer.running)
+        {
+            writer.first = writer.last = NULL;
+            --writer.pending;
+            pthread_mutex_unlock(&writer.lock);
+
+            ERROR("screenshot: failed to start the writer thread\n");
+            free(job->frame);
+            free(job->dir);
+            free(job);
+            return -1;
+        }
+    }
+    else
+        pthread_cond_signal(&writer.cond);
+    pthread_mutex_unlock(&writer.lock);
+
+    // flash, the writer thread draws the scene again after a while
+    fb_fill(WHITE);
+    fb_update();
+    writer.flash_end = gettime_us() + FLASH_MS*1000;
+    return 0;
+}
+
+void screenshot_flush(void)
+{
+    pthread_mutex_lock(&writer.lock);
+    if(!writer.running)
+    {
+        pthread_mutex_unlock(&writer.lock);
+        return;
+    }
+    writer.quit = 1;
+    pthread_cond_signal(&writer.cond);
+    pthread_mutex_unlock(&writer.lock);
+
+    pthread_join(writer.thread, NULL);
+    writer.running = 0;
+}
@@ -0,0 +1,11 @@
+#ifndef SCREENSHOT_H
+#define SCREENSHOT_H
+
+// Screenshots are copies of the shown frame, which a background thread
+// encodes to QOI and writes to dir/screenshot_NN.qoi. The caller waits
+// only for the copy, never for the storage.
+int screenshot_take(const char *dir);
+// writes all queued screenshots and stops the thread
+void screenshot_flush(void);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "timers.h"
+#include "util.h"
+#include "log.h"
+
+typedef struct
+{
+    timer_callback callback;
+    void *data;
+    uint64_t period_us;
+    uint64_t due;
+    int removed; // by its own callback, the thread frees it
+} timer_entry;
+
+static struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;      // timers changed
+    pthread_cond_t done_cond; // a callback has finished
+    int running;
+    timer_entry **timers;
+    timer_entry *active; // the one which is being called
+} timers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static timer_entry *timer_find(timer_callback callback, void *data)
+{
+    int i;
+    for(i = 0; timers.timers && timers.timers[i]; ++i)
+        if(timers.timers[i]->callback == callback && timers.timers[i]->data == data && !timers.timers[i]->removed)
+            return timers.timers[i];
+    return NULL;
+}
+
+static timer_entry *timer_next(void)
+{
+    timer_entry *res = NULL;
+    int i;
+    for(i = 0; timers.timers && timers.timers[i]; ++i)
+        if(!res || timers.timers[i]->due < res->due)
+            res = timers.timers[i];
+    return res;
+}
+
+// cond waits use the realtime clock, gettime_us() is monotonic
+static void timer_wait_until(uint64_t due)
+{
+    struct timeval tv;
+    struct timespec ts;
+    uint64_t now = gettime_us();
+    uint64_t abs;
+
+    gettimeofday(&tv, NULL);
+    abs = (uint64_t)tv.tv_sec*1000000 + tv.tv_usec + (due - now);
+    ts.tv_sec = abs/1000000;
+    ts.tv_nsec = (abs%1000000)*1000;
+    pthread_cond_timedwait(&timers.cond, &timers.lock, &ts);
+}
+
+static void *timer_thread_work(void *data)
+{
+    timer_entry *t;
+    uint64_t now;
+    int res;
+
+    pthread_mutex_lock(&timers.lock);
+    while(1)
+    {
+        t = timer_next();
+        now = gettime_us();
+
+        if(!t)
+            pthread_cond_wait(&timers.cond, &timers.lock);
+        else if(t->due > now)
+            timer_wait_until(t->due);
+        else
+        {
+            timers.active = t;
+            pthread_mutex_unlock(&timers.lock);
+
+            res = (*t->callback)(t->data);
+
+            pthread_mutex_lock(&timers.lock);
+            timers.active = NULL;
+            pthread_cond_broadcast(&timers.done_cond);
+
+            if(res == 0 || t->removed)
+                list_rm(t, &timers.timers, &free);
+            else
+            {
+                // skip the missed periods instead of calling it in a burst
+                t->due += t->period_us;
+                if(t->due <= now)
+                    t->due = now + t->period_us;
+            }
+        }
+        wakeup_count();
+    }
+    pthread_mutex_unlock(&timers.lock);
+    return NULL;
+}
+
+void timer_add(int period_ms, timer_callback callback, void *data)
+{
+    timer_entry *t = malloc(sizeof(timer_entry));
+    memset(t, 0, sizeof(timer_entry));
+    t->callback = callback;
+    t->data = data;
+    t->period_us = (uint64_t)period_ms*1000;
+
+    pthread_mutex_lock(&timers.lock);
+    t->due = gettime_us() + t->period_us;
+    list_add(t, &timers.timers);
+
+    if(!timers.running)
+    {
+        timers.running = (pthread_create(&timers.thread, NULL, timer_thread_work, NULL) == 0);
+        if(!timers.running)
+            ERROR("timers: failed to start the thread\n");
+    }
+    else
+        pthread_cond_signal(&timers.cond);
+    pthread_mutex_unlock(&timers.lock);
+}
+
+void timer_rm(timer_callback callback, void *data)
+{
+    timer_entry *t;
+
+    pthread_mutex_lock(&timers.lock);
+    t = timer_find(callback, data);
+    if(t && timers.active == t && pthread_equal(pthread_self(), timers.thread))
+        t->removed = 1;
+    else if(t)
+    {
+        // the thread frees t if its callback returns 0, look it up again
+        while(t && timers.active == t)
+        {
+            pthread_cond_wait(&timers.done_cond, &timers.lock);
+            t = timer_find(callback, data);
+        }
+        if(t)
+        {
+            list_rm(t, &timers.timers, &free);
+            pthread_cond_signal(&timers.cond);
+        }
+    }
+    pthread_mutex_unlock(&timers.lock);
+}
@@ -0,0 +1,14 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+typedef int (*timer_callback)(void*); // data, returns 0 to stop the timer
+
+// Periodic callbacks for animations. All of them run on one thread, which
+// sleeps until the nearest one is due, without any timers it doesn't wake
+// up at all. The callback is called every period_ms until it returns 0 or
+// it is removed.
+void timer_add(int period_ms, timer_callback callback, void *data);
+// the callback is not running anymore when this returns
+void timer_rm(timer_callback callback, void *data);
+
+#endif
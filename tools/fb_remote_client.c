@@ -0,0 +1,350 @@
+/*
+ * Client of the remote framebuffer server in fb_remote.c. Rebuilds every
+ * frame from the tiles exactly as the device has it and writes it out as
+ * PPM, or as raw pixels in the framebuffer's format with -r. It needs
+ * only fb_remote.h:
+ *
+ *   adb forward tcp:8787 tcp:8787
+ *   cc -I.. -o fb_remote_client fb_remote_client.c
+ *   ./fb_remote_client -o frame.ppm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "fb_remote.h"
+
+// FB_FMT_* of fb_format.h
+enum
+{
+    FMT_RGBX8888,
+    FMT_BGRX8888,
+    FMT_RGB565,
+};
+
+static struct
+{
+    int fd;
+    int w, h;
+    int format;
+    int bpp;
+    uint8_t *px; // w*h pixels in the native format, no padding
+    uint8_t *buf;
+    uint32_t buf_size;
+} client = {
+    .fd = -1,
+};
+
+static int recv_all(void *data, uint32_t len)
+{
+    uint8_t *p = data;
+    int res;
+
+    while(len > 0)
+    {
+        res = recv(client.fd, p, len, 0);
+        if(res < 0 && errno == EINTR)
+            continue;
+        if(res <= 0)
+            return -1;
+        p += res;
+        len -= res;
+    }
+    return 0;
+}
+
+// returns the payload of the next message in client.buf, or -1
+static int recv_msg(fb_remote_msg *msg)
+{
+    if(recv_all(msg, sizeof(*msg)) < 0)
+        return -1;
+
+    if(msg->len > client.buf_size)
+    {
+        free(client.buf);
+        client.buf_size = msg->len;
+        client.buf = malloc(client.buf_size);
+        if(!client.buf)
+            return -1;
+    }
+    return recv_all(client.buf, msg->len);
+}
+
+static inline uint32_t get_px(const uint8_t *p, int bpp)
+{
+    uint32_t v = 0;
+    memcpy(&v, p, bpp);
+    return v;
+}
+
+// RLE runs of the tile, XORed with what is there with xor set
+static int decode_rle(fb_remote_tile *t, const uint8_t *data, int xor)
+{
+    const int bpp = client.bpp;
+    uint32_t i = 0, n, val, px, end = t->w*t->h;
+    const uint8_t *p = data, *data_end = data + t->len;
+    uint8_t *dst;
+
+    while(p + 2 + bpp <= data_end)
+    {
+        n = p[0] | (p[1] << 8);
+        val = get_px(p + 2, bpp);
+        p += 2 + bpp;
+
+        if(n == 0 || i + n > end)
+            return -1;
+
+        for(; n > 0; --n, ++i)
+        {
+            dst = client.px + ((t->y + i/t->w)*client.w + t->x + i%t->w)*bpp;
+            px = xor ? val ^ get_px(dst, bpp) : val;
+            memcpy(dst, &px, bpp);
+        }
+    }
+    return (i == end && p == data_end) ? 0 : -1;
+}
+
+static int decode_tile(fb_remote_tile *t, const uint8_t *data)
+{
+    uint32_t y;
+
+    if(t->w == 0 || t->h == 0 || t->x + t->w > client.w || t->y + t->h > client.h)
+        return -1;
+
+    switch(t->enc)
+    {
+        case FB_REMOTE_ENC_RAW:
+            if(t->len != (uint32_t)t->w*t->h*client.bpp)
+                return -1;
+            for(y = 0; y < t->h; ++y)
+            {
+                memcpy(client.px + ((t->y + y)*client.w + t->x)*client.bpp,
+                       data + y*t->w*client.bpp, t->w*client.bpp);
+            }
+            return 0;
+        case FB_REMOTE_ENC_RLE:
+            return decode_rle(t, data, 0);
+        case FB_REMOTE_ENC_XOR_RLE:
+            return decode_rle(t, data, 1);
+        default:
+            return -1;
+    }
+}
+
+static int decode_frame(const uint8_t *data, uint32_t len, uint32_t *tiles)
+{
+    const uint8_t *p = data + sizeof(uint32_t);
+    const uint8_t *end = data + len;
+    fb_remote_tile t;
+    uint32_t i;
+
+    if(len < sizeof(uint32_t))
+        return -1;
+    memcpy(tiles, data, sizeof(uint32_t));
+
+    for(i = 0; i < *tiles; ++i)
+    {
+        if(p + sizeof(t) > end)
+            return -1;
+        memcpy(&t, p, sizeof(t));
+        p += sizeof(t);
+
+        if(p + t.len > end || decode_tile(&t, p) < 0)
+            return -1;
+        p += t.len;
+    }
+    return p == end ? 0 : -1;
+}
+
+static void px_to_rgb(uint32_t px, uint8_t *rgb)
+{
+    uint32_t r, g, b;
+
+    switch(client.format)
+    {
+        case FMT_RGBX8888:
+            rgb[0] = px;
+            rgb[1] = px >> 8;
+            rgb[2] = px >> 16;
+            break;
+        case FMT_BGRX8888:
+            rgb[0] = px >> 16;
+            rgb[1] = px >> 8;
+            rgb[2] = px;
+            break;
+        case FMT_RGB565:
+            // the same as rgb565_to_color() of fb_format.c
+            r = (px >> 11) & 0x1F;
+            g = (px >> 5) & 0x3F;
+            b = px & 0x1F;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+            break;
+    }
+}
+
+static int write_frame(const char *path, int raw)
+{
+    uint8_t rgb[3];
+    int i, res;
+    FILE *f = fopen(path, "w");
+    if(!f)
+    {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if(raw)
+        fwrite(client.px, client.bpp, client.w*client.h, f);
+    else
+    {
+        fprintf(f, "P6\n%d %d\n255\n", client.w, client.h);
+        for(i = 0; i < client.w*client.h; ++i)
+        {
+            px_to_rgb(get_px(client.px + i*client.bpp, client.bpp), rgb);
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+
+    res = fclose(f);
+    return res == 0 ? 0 : -1;
+}
+
+static int connect_to(const char *addr, int port)
+{
+    struct sockaddr_in sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    if(inet_pton(AF_INET, addr, &sa.sin_addr) != 1)
+    {
+        fprintf(stderr, "bad address %s\n", addr);
+        return -1;
+    }
+
+    client.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(client.fd < 0 || connect(client.fd, (struct sockaddr*)&sa, sizeof(sa)) < 0)
+    {
+        fprintf(stderr, "failed to connect to %s:%d: %s\n", addr, port, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [options]\n"
+           "  -a ADDR             address of the server (127.0.0.1)\n"
+           "  -p PORT             port of the server (%d)\n"
+           "  -o FILE             written after every frame (frame.ppm)\n"
+           "  -r                  write raw pixels in the framebuffer's format\n"
+           "  -n FRAMES           quit after FRAMES frames\n"
+           "  -i MS               quit when no frame came for MS\n"
+           "  -v                  print every frame\n", name, FB_REMOTE_PORT);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *addr = "127.0.0.1";
+    const char *out = "frame.ppm";
+    int port = FB_REMOTE_PORT, raw = 0, max_frames = 0, idle_ms = -1, verbose = 0;
+    fb_remote_hello hello;
+    fb_remote_msg msg;
+    struct pollfd pfd;
+    uint32_t frames = 0, tiles, bytes = 0;
+    int c, res;
+
+    while((c = getopt(argc, argv, "a:p:o:rn:i:vh")) != -1)
+    {
+        switch(c)
+        {
+            case 'a': addr = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'o': out = optarg; break;
+            case 'r': raw = 1; break;
+            case 'n': max_frames = atoi(optarg); break;
+            case 'i': idle_ms = atoi(optarg); break;
+            case 'v': verbose = 1; break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(connect_to(addr, port) < 0)
+        return 1;
+
+    if(recv_msg(&msg) < 0 || msg.type != FB_REMOTE_HELLO || msg.len != sizeof(hello))
+    {
+        fprintf(stderr, "the server did not say hello\n");
+        return 1;
+    }
+    memcpy(&hello, client.buf, sizeof(hello));
+
+    client.w = hello.w;
+    client.h = hello.h;
+    client.format = hello.format;
+    client.bpp = hello.format == FMT_RGB565 ? 2 : 4;
+    if(client.format > FMT_RGB565 || client.w <= 0 || client.h <= 0)
+    {
+        fprintf(stderr, "unknown framebuffer %dx%d, format %d\n", client.w, client.h, client.format);
+        return 1;
+    }
+    client.px = calloc(client.w*client.h, client.bpp);
+    printf("%dx%d, format %d\n", client.w, client.h, client.format);
+
+    res = 0;
+    while(max_frames == 0 || (int)frames < max_frames)
+    {
+        pfd.fd = client.fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, idle_ms) == 0)
+            break;
+
+        if(recv_msg(&msg) < 0)
+        {
+            fprintf(stderr, "the server closed the connection\n");
+            res = 1;
+            break;
+        }
+        if(msg.type != FB_REMOTE_FRAME)
+            continue;
+
+        if(decode_frame(client.buf, msg.len, &tiles) < 0)
+        {
+            fprintf(stderr, "frame %u is broken\n", frames);
+            res = 1;
+            break;
+        }
+
+        ++frames;
+        bytes += msg.len;
+        if(verbose)
+            printf("frame %u: %u tiles, %u bytes\n", frames, tiles, msg.len);
+
+        if(write_frame(out, raw) < 0)
+        {
+            res = 1;
+            break;
+        }
+    }
+
+    printf("%u frames, %u bytes\n", frames, bytes);
+    close(client.fd);
+    free(client.px);
+    free(client.buf);
+    return res;
+}
@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <time.h>
 #include <dirent.h>
+#include <malloc.h>
 
 #ifdef HAVE_SELINUX
 #include <selinux/label.h>
@@ -280,6 +281,45 @@ time_t gettime(void)
     return ts.tv_sec;
 }
 
+/*
+ * gettime_us() - returns the time in microseconds of the system's monotonic
+ * clock or zero on error.
+ */
+uint64_t gettime_us(void)
+{
+    struct timespec ts;
+
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+        ERROR("clock_gettime(CLOCK_MONOTONIC) failed: %s\n", strerror(errno));
+        return 0;
+    }
+
+    return ((uint64_t)ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
+static volatile uint32_t wakeups = 0;
+static uint32_t wakeups_last = 0;
+static uint64_t wakeups_last_time = 0;
+
+void wakeup_count(void)
+{
+    __sync_fetch_and_add(&wakeups, 1);
+}
+
+int wakeup_rate(void)
+{
+    uint32_t cnt = wakeups;
+    uint64_t now = gettime_us();
+    int res = 0;
+
+    if(wakeups_last_time != 0 && now > wakeups_last_time)
+        res = (uint64_t)(cnt - wakeups_last)*1000000/(now - wakeups_last_time);
+
+    wakeups_last = cnt;
+    wakeups_last_time = now;
+    return res;
+}
+
 int mkdir_recursive(const char *pathname, mode_t mode)
 {
     char buf[128];
@@ -666,6 +706,27 @@ char *run_get_stdout(char **cmd)
     return NULL;
 }
 
+// Lists grow in power-of-two sizes (counting the terminating NULL) and
+// shrink only when they are mostly empty, so that adding and removing
+// items doesn't realloc every time.
+static int list_capacity(int size)
+{
+    int cap = 4;
+    while(cap < size)
+        cap *= 2;
+    return cap;
+}
+
+static void list_resize(void ***list, int size)
+{
+    size_t avail = *list ? malloc_usable_size(*list)/sizeof(void*) : 0;
+
+    if(size <= (int)avail && (avail <= 8 || size > (int)avail/4))
+        return;
+
+    *list = realloc(*list, list_capacity(size)*sizeof(void*));
+}
+
 int list_item_count(listItself list)
 {
     void **l = (void**)list;
@@ -687,12 +748,11 @@ void list_add(void *item, ptrToList list_p)
     int i = 0;
     while(*list && (*list)[i])
         ++i;
-    i += 2;
 
-    *list = realloc(*list, i*sizeof(item));
+    list_resize(list, i+2);
 
-    (*list)[--i] = NULL;
-    (*list)[--i] = item;
+    (*list)[i] = item;
+    (*list)[i+1] = NULL;
 }
 
 int list_rm(void *item, ptrToList list_p, callback destroy_callback_p)
@@ -722,8 +782,8 @@ int list_rm(void *item, ptrToList list_p, callback destroy_callback_p)
         if(i != size-1)
             (*list)[i] = (*list)[size-1];
 
-        *list= realloc(*list, size*sizeof(item));
         (*list)[size-1] = NULL;
+        list_resize(list, size);
         return 0;
     }
     return -1;
@@ -754,7 +814,8 @@ int list_rm_at(int idx, ptrToList list_p, callback destroy_callback_p)
     for(; i+1 < size; ++i)
         (*list)[i] = (*list)[i+1];
 
-    *list= realloc(*list, size*sizeof(item));
+    (*list)[size-1] = NULL;
+    list_resize(list, size);
     return 0;
 }
 
@@ -789,7 +850,7 @@ int list_copy(listItself src, ptrToList dest_p)
         return -1;
 
     int size = list_size(source);
-    *dest = calloc(size, sizeof(*source));
+    *dest = calloc(list_capacity(size), sizeof(*source));
 
     int i;
     for(i = 0; source[i]; ++i)
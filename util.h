@@ -19,6 +19,7 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <stdint.h>
 
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 
@@ -29,6 +30,11 @@ int create_socket(const char *name, int type, mode_t perm,
                   uid_t uid, gid_t gid);
 void *read_file(const char *fn, unsigned *_sz);
 time_t gettime(void);
+uint64_t gettime_us(void);
+// Every thread loop counts its wakeups here, an idle UI should have none.
+void wakeup_count(void);
+// wakeups per second since the previous call, 0 for the first one
+int wakeup_rate(void);
 unsigned int decode_uid(const char *s);
 
 int mkdir_recursive(const char *pathname, mode_t mode);
@@ -66,6 +72,9 @@ void list_clear(ptrToList list_p, callback destroy_callback_p);
 
 inline int in_rect(int x, int y, int rx, int ry, int rw, int rh);
 
+static inline int imin(int a, int b) { return a < b ? a : b; }
+static inline int imax(int a, int b) { return a > b ? a : b; }
+
 typedef struct
 {
     char **keys;
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "widget.h"
+#include "util.h"
+
+static fb_bbox *widget_clip(widget *w)
+{
+    for(; w; w = w->parent)
+        if(w->clip)
+            return w->clip;
+    return NULL;
+}
+
+// moves all items and children of w by dx, dy
+static void widget_shift(widget *w, int dx, int dy)
+{
+    int i;
+
+    w->abs_x += dx;
+    w->abs_y += dy;
+
+    for(i = 0; w->items && w->items[i]; ++i)
+    {
+        w->items[i]->x += dx;
+        w->items[i]->y += dy;
+    }
+
+    for(i = 0; w->children && w->children[i]; ++i)
+        widget_shift(w->children[i], dx, dy);
+}
+
+static void widget_apply_clip(widget *w, fb_bbox *clip)
+{
+    int i;
+
+    if(w->clip)
+        clip = w->clip;
+
+    for(i = 0; w->items && w->items[i]; ++i)
+        w->items[i]->clip = clip;
+
+    for(i = 0; w->children && w->children[i]; ++i)
+        widget_apply_clip(w->children[i], clip);
+}
+
+widget *widget_create(widget *parent, int x, int y)
+{
+    widget *w = malloc(sizeof(widget));
+    memset(w, 0, sizeof(widget));
+
+    w->parent = parent;
+    w->x = x;
+    w->y = y;
+    w->abs_x = x;
+    w->abs_y = y;
+
+    if(parent)
+    {
+        w->abs_x += parent->abs_x;
+        w->abs_y += parent->abs_y;
+        list_add(w, &parent->children);
+    }
+    return w;
+}
+
+static void widget_free(widget *w)
+{
+    list_clear(&w->items, &fb_remove_item);
+    list_clear(&w->children, &widget_free);
+    free(w);
+}
+
+void widget_destroy(widget *w)
+{
+    if(!w)
+        return;
+
+    if(w->parent)
+        list_rm(w, &w->parent->children, NULL);
+
+    widget_free(w);
+}
+
+void widget_move(widget *w, int x, int y)
+{
+    if(x == w->x && y == w->y)
+        return;
+
+    widget_shift(w, x - w->x, y - w->y);
+    w->x = x;
+    w->y = y;
+}
+
+void widget_set_clip(widget *w, fb_bbox *clip)
+{
+    w->clip = clip;
+    widget_apply_clip(w, widget_clip(w));
+}
+
+fb_rect *widget_add_rect(widget *w, int x, int y, int width, int height, uint32_t color)
+{
+    fb_rect *r = fb_add_rect_clipped(widget_clip(w), w->abs_x + x, w->abs_y + y, width, height, color);
+    list_add(r, &w->items);
+    return r;
+}
+
+fb_text *widget_add_text(widget *w, int x, int y, uint32_t color, int size, const char *text)
+{
+    fb_text *t = fb_add_text_clipped(widget_clip(w), w->abs_x + x, w->abs_y + y, color, size, text);
+    list_add(t, &w->items);
+    return t;
+}
+
+fb_image *widget_add_image(widget *w, int x, int y, int max_w, int max_h, const char *path)
+{
+    fb_image *im = fb_add_image_clipped(widget_clip(w), w->abs_x + x, w->abs_y + y, max_w, max_h, path);
+    if(!im)
+        return NULL;
+
+    list_add(im, &w->items);
+    return im;
+}
+
+void widget_move_item(widget *w, void *item, int x, int y)
+{
+    fb_item_header *h = (fb_item_header*)item;
+    h->x = w->abs_x + x;
+    h->y = w->abs_y + y;
+}
+
+void widget_rm_item(widget *w, void *item)
+{
+    if(item && list_rm(item, &w->items, NULL) == 0)
+        fb_remove_item(item);
+}
@@ -0,0 +1,34 @@
+#ifndef WIDGET_H
+#define WIDGET_H
+
+#include "framebuffer.h"
+
+// Widgets form a tree which owns the fb items of the UI. Items and child
+// widgets are placed relative to their widget, so moving a widget lays
+// out its whole subtree again and destroying it removes everything in it.
+// The renderer then damages only the items whose position changed.
+typedef struct widget
+{
+    int x, y;         // relative to the parent
+    int abs_x, abs_y; // on the screen
+    fb_bbox *clip;    // clip of the items in the subtree, NULL to use the parent's
+
+    struct widget *parent;
+    struct widget **children;
+    fb_item_header **items;
+} widget;
+
+widget *widget_create(widget *parent, int x, int y);
+void widget_destroy(widget *w);
+void widget_move(widget *w, int x, int y);
+void widget_set_clip(widget *w, fb_bbox *clip);
+
+// x and y are relative to the widget
+fb_rect *widget_add_rect(widget *w, int x, int y, int width, int height, uint32_t color);
+fb_text *widget_add_text(widget *w, int x, int y, uint32_t color, int size, const char *text);
+// the image is cropped to max_w x max_h, -1 for no limit
+fb_image *widget_add_image(widget *w, int x, int y, int max_w, int max_h, const char *path);
+void widget_move_item(widget *w, void *item, int x, int y);
+void widget_rm_item(widget *w, void *item);
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "workers.h"
+#include "log.h"
+
+// Small pool of threads for splitting work on independent jobs (e.g.
+// screen tiles). Jobs are split evenly into per-worker queues, each worker
+// takes jobs from the front of its own queue and when that one is empty,
+// steals from the back of the others. The thread which calls workers_run()
+// works as worker 0.
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    int next;
+    int end;
+} worker_queue;
+
+static struct
+{
+    int count;
+    pthread_t threads[WORKERS_MAX];
+    worker_queue queues[WORKERS_MAX];
+
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned generation;
+    unsigned start_generation;
+    int running;
+    int quit;
+
+    worker_job job;
+    void *data;
+} pool = {
+    .count = 1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int worker_take(int w)
+{
+    worker_queue *q;
+    int i, res = -1;
+
+    q = &pool.queues[w];
+    pthread_mutex_lock(&q->lock);
+    if(q->next < q->end)
+        res = q->next++;
+    pthread_mutex_unlock(&q->lock);
+
+    for(i = 1; res == -1 && i < pool.count; ++i)
+    {
+        q = &pool.queues[(w + i) % pool.count];
+        pthread_mutex_lock(&q->lock);
+        if(q->next < q->end)
+            res = --q->end;
+        pthread_mutex_unlock(&q->lock);
+    }
+    return res;
+}
+
+static void worker_loop(int w)
+{
+    int idx;
+    while((idx = worker_take(w)) != -1)
+        (*pool.job)(idx, w, pool.data);
+}
+
+static void *worker_thread(void *data)
+{
+    int w = (int)(intptr_t)data;
+    unsigned gen;
+
+    pthread_mutex_lock(&pool.lock);
+    gen = pool.start_generation;
+    while(1)
+    {
+        while(!pool.quit && pool.generation == gen)
+            pthread_cond_wait(&pool.start_cond, &pool.lock);
+
+        if(pool.quit)
+            break;
+
+        gen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        worker_loop(w);
+
+        pthread_mutex_lock(&pool.lock);
+        if(--pool.running == 0)
+            pthread_cond_signal(&pool.done_cond);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+int workers_start(int count)
+{
+    int i;
+
+    workers_stop();
+
+    if(count < 1)
+        count = 1;
+    else if(count > WORKERS_MAX)
+        count = WORKERS_MAX;
+
+    // Threads must not read pool.generation themselves, workers_run() could
+    // already bump it before they get to run.
+    pool.quit = 0;
+    pool.count = 1;
+    pool.start_generation = pool.generation;
+    for(i = 0; i < count; ++i)
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+
+    for(i = 1; i < count; ++i)
+    {
+        if(pthread_create(&pool.threads[i], NULL, worker_thread, (void*)(intptr_t)i) != 0)
+        {
+            ERROR("workers: failed to create thread %d\n", i);
+            break;
+        }
+        pool.count = i+1;
+    }
+    return pool.count;
+}
+
+void workers_stop(void)
+{
+    int i;
+
+    if(pool.count <= 1)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = 1;
+    pthread_cond_broadcast(&pool.start_cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for(i = 1; i < pool.count; ++i)
+        pthread_join(pool.threads[i], NULL);
+
+    pool.count = 1;
+}
+
+int workers_count(void)
+{
+    return pool.count;
+}
+
+void workers_run(int jobs, worker_job job, void *data)
+{
+    int i;
+
+    if(pool.count <= 1 || jobs <= 1)
+    {
+        for(i = 0; i < jobs; ++i)
+            (*job)(i, 0, data);
+        return;
+    }
+
+    for(i = 0; i < pool.count; ++i)
+    {
+        pool.queues[i].next = (jobs*i)/pool.count;
+        pool.queues[i].end = (jobs*(i+1))/pool.count;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.job = job;
+    pool.data = data;
+    pool.running = pool.count - 1;
+    ++pool.generation;
+    pthread_cond_broadcast(&pool.start_cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    worker_loop(0);
+
+    pthread_mutex_lock(&pool.lock);
+    while(pool.running > 0)
+        pthread_cond_wait(&pool.done_cond, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
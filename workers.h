@@ -0,0 +1,13 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#define WORKERS_MAX 8
+
+typedef void (*worker_job)(int, int, void*); // job index, worker index, data
+
+int workers_start(int count);
+void workers_stop(void);
+int workers_count(void);
+void workers_run(int jobs, worker_job job, void *data);
+
+#endif